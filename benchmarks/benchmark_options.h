@@ -0,0 +1,219 @@
+#ifndef HELPERS_BENCHMARK_OPTIONS
+#define HELPERS_BENCHMARK_OPTIONS
+
+// Command line parsing and output shared by the benchmark executables: options are --name=value, results are
+// written as CSV or JSON, one record per run.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace benchmarks
+{
+
+/// \struct output_options
+/// Options every benchmark takes: --format=csv|json and --output=file, stdout if empty.
+struct output_options
+{
+    std::string format{ "csv" };
+    std::string output;
+};
+
+/// \struct field
+/// Named value of a record. Text is quoted in JSON, an empty number is left empty in CSV and is null in JSON.
+struct field
+{
+    std::string name;
+    std::string value;
+    bool text;
+};
+
+using fields = std::vector< field >;
+
+inline field text_field( const std::string& name, const std::string& value )
+{
+    return field{ name, value, true };
+}
+
+template< typename T >
+field number_field( const std::string& name, T value )
+{
+    return field{ name, std::to_string( value ), false };
+}
+
+inline field empty_field( const std::string& name )
+{
+    return field{ name, std::string{}, false };
+}
+
+/// Comma separated list of numbers, each one at least min_value.
+inline std::vector< size_t > parse_list( const std::string& value, size_t min_value = 0 )
+{
+    std::vector< size_t > result;
+    std::stringstream stream{ value };
+    std::string item;
+
+    while( std::getline( stream, item, ',' ) )
+    {
+        result.emplace_back( std::max( static_cast< size_t >( std::stoull( item ) ), min_value ) );
+    }
+
+    if( result.empty() )
+    {
+        throw std::invalid_argument{ "Empty list" };
+    }
+
+    return result;
+}
+
+/// Powers of two up to the hardware concurrency, which is the last one.
+inline std::vector< size_t > default_thread_counts()
+{
+    std::vector< size_t > result;
+
+    for( size_t threads{ 1 }; threads < std::thread::hardware_concurrency(); threads *= 2 )
+    {
+        result.emplace_back( threads );
+    }
+
+    result.emplace_back( std::max( std::thread::hardware_concurrency(), 1u ) );
+
+    return result;
+}
+
+/// Splits each argument into name and value and passes them to parse( name, value ), which returns false for
+/// an unknown option or an invalid value. Format and output are handled here.
+/// Throws std::invalid_argument for a malformed or an unknown argument.
+template< typename Parse >
+void parse_arguments( int argc, char** argv, output_options& output, Parse parse )
+{
+    for( int i{ 1 }; i < argc; ++i )
+    {
+        const std::string argument{ argv[ i ] };
+        const size_t separator{ argument.find( '=' ) };
+
+        if( argument.compare( 0, 2, "--" ) != 0 || separator == std::string::npos )
+        {
+            throw std::invalid_argument{ "Invalid argument: " + argument };
+        }
+
+        const std::string name{ argument.substr( 2, separator - 2 ) };
+        const std::string value{ argument.substr( separator + 1 ) };
+
+        if( name == "format" && ( value == "csv" || value == "json" ) )
+        {
+            output.format = value;
+        }
+        else if( name == "output" )
+        {
+            output.output = value;
+        }
+        else if( !parse( name, value ) )
+        {
+            throw std::invalid_argument{ "Invalid argument: " + argument };
+        }
+    }
+}
+
+/// Operations per second, 0 if nothing was measured.
+inline double rate( uint64_t operations, std::chrono::nanoseconds elapsed )
+{
+    const double seconds{ std::chrono::duration< double >( elapsed ).count() };
+    return seconds > 0 ? static_cast< double >( operations ) / seconds : 0;
+}
+
+/// CSV with a header from the names of the first record's fields, or a JSON array of objects.
+inline void write_records( std::ostream& out, const std::string& format, const std::vector< fields >& records )
+{
+    const bool json{ format == "json" };
+
+    if( json )
+    {
+        out << "[\n";
+    }
+    else if( !records.empty() )
+    {
+        for( size_t i{ 0 }; i < records.front().size(); ++i )
+        {
+            out << ( i ? "," : "" ) << records.front()[ i ].name;
+        }
+
+        out << '\n';
+    }
+
+    for( size_t i{ 0 }; i < records.size(); ++i )
+    {
+        const fields& record = records[ i ];
+
+        for( size_t j{ 0 }; j < record.size(); ++j )
+        {
+            const field& f = record[ j ];
+
+            if( json )
+            {
+                out << ( j ? ", \"" : "  { \"" ) << f.name << "\": ";
+
+                if( f.text )
+                {
+                    out << '"' << f.value << '"';
+                }
+                else
+                {
+                    out << ( f.value.empty() ? "null" : f.value );
+                }
+            }
+            else
+            {
+                out << ( j ? "," : "" ) << f.value;
+            }
+        }
+
+        if( json )
+        {
+            out << ( i + 1 < records.size() ? " },\n" : " }\n" );
+        }
+        else
+        {
+            out << '\n';
+        }
+    }
+
+    if( json )
+    {
+        out << "]\n";
+    }
+}
+
+/// Writes the records to the output file, or to stdout. Returns the exit code of the benchmark.
+inline int write_output( const output_options& o, const std::vector< fields >& records )
+{
+    if( o.output.empty() )
+    {
+        write_records( std::cout, o.format, records );
+        return EXIT_SUCCESS;
+    }
+
+    std::ofstream file{ o.output };
+
+    if( !file )
+    {
+        std::cerr << "Can't open " << o.output << '\n';
+        return EXIT_FAILURE;
+    }
+
+    write_records( file, o.format, records );
+
+    return EXIT_SUCCESS;
+}
+
+}// benchmarks
+
+#endif
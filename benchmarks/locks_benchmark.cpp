@@ -0,0 +1,264 @@
+// Read-mostly locks benchmark: reader threads copy a small struct for a fixed time while a writer updates it
+// at a fixed interval, with seqlock, rw_spinlock, fair_rw_spinlock and br_spinlock. Results are written as
+// CSV or JSON, one record per run.
+//
+// Usage: locks_benchmark [--readers=1,2,4] [--duration-ms=N] [--write-interval-us=N] [--repetitions=N]
+//                        [--format=csv|json] [--output=file]
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "atomic_locks.h"
+#include "benchmark_options.h"
+
+using namespace helpers::concurrency;
+using namespace benchmarks;
+
+namespace
+{
+
+using clock_type = std::chrono::steady_clock;
+
+struct options : output_options
+{
+    std::vector< size_t > readers{ default_thread_counts() };
+    std::chrono::milliseconds duration{ 500 };
+    // No writer if 0
+    std::chrono::microseconds write_interval{ 100 };
+    size_t repetitions{ 3 };
+};
+
+struct record
+{
+    std::string lock;
+    size_t readers{ 0 };
+    size_t repetition{ 0 };
+    uint64_t reads{ 0 };
+    uint64_t writes{ 0 };
+    std::chrono::nanoseconds elapsed{ 0 };
+};
+
+// Value read under the lock, small enough for a seqlock, big enough to be torn without one
+struct config
+{
+    uint64_t version;
+    uint64_t offset;
+    uint64_t scale;
+    uint64_t flags;
+};
+
+config next( const config& c )
+{
+    return config{ c.version + 1, c.offset + 3, c.scale + 5, c.flags ^ 1 };
+}
+
+// Keeps the reads from being optimized out
+volatile uint64_t sink{ 0 };
+
+options parse_options( int argc, char** argv )
+{
+    options result;
+
+    parse_arguments( argc, argv, result, [ &result ]( const std::string& name, const std::string& value )
+    {
+        if( name == "readers" )
+        {
+            result.readers = parse_list( value, 1 );
+        }
+        else if( name == "duration-ms" )
+        {
+            result.duration = std::chrono::milliseconds{ std::max< long long >( std::stoll( value ), 1 ) };
+        }
+        else if( name == "write-interval-us" )
+        {
+            result.write_interval = std::chrono::microseconds{ std::max< long long >( std::stoll( value ), 0 ) };
+        }
+        else if( name == "repetitions" )
+        {
+            result.repetitions = std::max< size_t >( static_cast< size_t >( std::stoull( value ) ), 1 );
+        }
+        else
+        {
+            return false;
+        }
+
+        return true;
+    } );
+
+    return result;
+}
+
+// Runs the readers and the writer for the duration, read() and write() are called with the lock's own protocol
+template< typename Read, typename Write >
+void run( record& r, const options& o, Read read, Write write )
+{
+    std::atomic_bool start{ false };
+    std::atomic_bool stop{ false };
+    std::atomic< uint64_t > reads{ 0 };
+    std::vector< std::thread > readers;
+
+    for( size_t i{ 0 }; i < r.readers; ++i )
+    {
+        readers.emplace_back( [ & ]()
+        {
+            while( !start.load( std::memory_order_acquire ) )
+            {
+                std::this_thread::yield();
+            }
+
+            uint64_t count{ 0 };
+            uint64_t sum{ 0 };
+
+            while( !stop.load( std::memory_order_relaxed ) )
+            {
+                sum += read();
+                ++count;
+            }
+
+            sink = sink + sum;
+            reads += count;
+        } );
+    }
+
+    uint64_t writes{ 0 };
+    const auto begin = clock_type::now();
+    const auto end = begin + o.duration;
+
+    start.store( true, std::memory_order_release );
+
+    if( o.write_interval.count() )
+    {
+        while( clock_type::now() < end )
+        {
+            write();
+            ++writes;
+            std::this_thread::sleep_for( o.write_interval );
+        }
+    }
+    else
+    {
+        std::this_thread::sleep_until( end );
+    }
+
+    stop = true;
+    for( auto& reader : readers )
+    {
+        reader.join();
+    }
+
+    r.elapsed = std::chrono::duration_cast< std::chrono::nanoseconds >( clock_type::now() - begin );
+    r.reads = reads;
+    r.writes = writes;
+}
+
+template< typename RwLock >
+void run_rw_lock( record& r, const options& o, RwLock& lock )
+{
+    config value{ 0, 0, 1, 0 };
+
+    run( r, o,
+         [ & ]()
+         {
+             basic_rw_spinlock_guard< RwLock > g{ lock, lock_mode::read };
+             return value.version + value.offset + value.scale + value.flags;
+         },
+         [ & ]()
+         {
+             basic_rw_spinlock_guard< RwLock > g{ lock, lock_mode::write };
+             value = next( value );
+         } );
+}
+
+void run_seqlock( record& r, const options& o )
+{
+    seqlock< config > value{ config{ 0, 0, 1, 0 } };
+
+    run( r, o,
+         [ & ]()
+         {
+             const config c{ value.load() };
+             return c.version + c.offset + c.scale + c.flags;
+         },
+         [ & ]()
+         {
+             value.update( []( config& c ){ c = next( c ); } );
+         } );
+}
+
+fields to_fields( const options& o, const record& r )
+{
+    return fields{ text_field( "lock", r.lock ),
+                   number_field( "readers", r.readers ),
+                   number_field( "write_interval_us", o.write_interval.count() ),
+                   number_field( "repetition", r.repetition ),
+                   number_field( "reads", r.reads ),
+                   number_field( "writes", r.writes ),
+                   number_field( "elapsed_ns", r.elapsed.count() ),
+                   number_field( "reads_per_sec", static_cast< uint64_t >( rate( r.reads, r.elapsed ) ) ),
+                   number_field( "writes_per_sec", static_cast< uint64_t >( rate( r.writes, r.elapsed ) ) ) };
+}
+
+}
+
+int main( int argc, char** argv )
+{
+    options o;
+
+    try
+    {
+        o = parse_options( argc, argv );
+    }
+    catch( const std::exception& e )
+    {
+        std::cerr << e.what() << "\nUsage: locks_benchmark [--readers=1,2,4] [--duration-ms=N] [--write-interval-us=N]"
+                                 " [--repetitions=N] [--format=csv|json] [--output=file]\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector< record > records;
+
+    for( const size_t readers : o.readers )
+    {
+        for( size_t repetition{ 0 }; repetition < o.repetitions; ++repetition )
+        {
+            auto add = [ & ]( const char* lock ) -> record&
+            {
+                records.emplace_back();
+
+                record& r = records.back();
+                r.lock = lock;
+                r.readers = readers;
+                r.repetition = repetition;
+
+                return r;
+            };
+
+            rw_spinlock rw_lock;
+            fair_rw_spinlock fair_lock;
+            br_spinlock br_lock;
+
+            run_seqlock( add( "seqlock" ), o );
+            run_rw_lock( add( "rw_spinlock" ), o, rw_lock );
+            run_rw_lock( add( "fair_rw_spinlock" ), o, fair_lock );
+            run_rw_lock( add( "br_spinlock" ), o, br_lock );
+
+            std::cerr << "readers " << readers << ", repetition " << repetition << " done\n";
+        }
+    }
+
+    std::vector< fields > output;
+
+    for( const auto& r : records )
+    {
+        output.emplace_back( to_fields( o, r ) );
+    }
+
+    return write_output( o, output );
+}
@@ -0,0 +1,378 @@
+// thread_pool benchmark: throughput, submit rates, fan-out/fan-in latency and wait_until_finished overhead,
+// swept over the numbers of workers and the task sizes. Results are written as CSV or JSON, one record per run.
+//
+// Usage: thread_pool_benchmark [--workers=1,2,4] [--task-sizes=0,1000] [--tasks=N] [--rounds=N]
+//                              [--producers=N] [--fan-out=N] [--repetitions=N]
+//                              [--policy=shared_queue|work_stealing] [--backend=locked|lock_free]
+//                              [--format=csv|json] [--output=file]
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "thread_pool.h"
+#include "benchmark_options.h"
+
+using namespace helpers::concurrency;
+using namespace benchmarks;
+
+namespace
+{
+
+using clock_type = std::chrono::steady_clock;
+
+struct options : output_options
+{
+    std::vector< size_t > workers{ default_thread_counts() };
+    std::vector< size_t > task_sizes{ 0, 100, 1000, 10000 };
+    size_t tasks{ 200000 };
+    size_t rounds{ 2000 };
+    size_t producers{ 4 };
+    size_t fan_out{ 64 };
+    size_t repetitions{ 3 };
+    scheduling_policy policy{ scheduling_policy::shared_queue };
+    queue_backend backend{ queue_backend::locked };
+};
+
+// Latencies are empty for the throughput scenarios
+struct record
+{
+    std::string scenario;
+    size_t workers{ 0 };
+    size_t producers{ 0 };
+    size_t task_size{ 0 };
+    size_t repetition{ 0 };
+    size_t operations{ 0 };
+    std::chrono::nanoseconds elapsed{ 0 };
+    std::vector< std::chrono::nanoseconds > latencies;
+};
+
+// Task size is a number of iterations of a loop the compiler can't remove
+void burn( size_t iterations )
+{
+    volatile size_t sink{ 0 };
+
+    for( size_t i{ 0 }; i < iterations; ++i )
+    {
+        sink = sink + i;
+    }
+}
+
+options parse_options( int argc, char** argv )
+{
+    options result;
+
+    parse_arguments( argc, argv, result, [ &result ]( const std::string& name, const std::string& value )
+    {
+        if( name == "workers" )
+        {
+            result.workers = parse_list( value );
+        }
+        else if( name == "task-sizes" )
+        {
+            result.task_sizes = parse_list( value );
+        }
+        else if( name == "tasks" )
+        {
+            result.tasks = static_cast< size_t >( std::stoull( value ) );
+        }
+        else if( name == "rounds" )
+        {
+            result.rounds = static_cast< size_t >( std::stoull( value ) );
+        }
+        else if( name == "producers" )
+        {
+            result.producers = std::max< size_t >( static_cast< size_t >( std::stoull( value ) ), 1 );
+        }
+        else if( name == "fan-out" )
+        {
+            result.fan_out = std::max< size_t >( static_cast< size_t >( std::stoull( value ) ), 1 );
+        }
+        else if( name == "repetitions" )
+        {
+            result.repetitions = std::max< size_t >( static_cast< size_t >( std::stoull( value ) ), 1 );
+        }
+        else if( name == "policy" && ( value == "shared_queue" || value == "work_stealing" ) )
+        {
+            result.policy = value == "shared_queue" ? scheduling_policy::shared_queue : scheduling_policy::work_stealing;
+        }
+        else if( name == "backend" && ( value == "locked" || value == "lock_free" ) )
+        {
+            result.backend = value == "locked" ? queue_backend::locked : queue_backend::lock_free;
+        }
+        else
+        {
+            return false;
+        }
+
+        return true;
+    } );
+
+    return result;
+}
+
+std::chrono::nanoseconds since( clock_type::time_point start )
+{
+    return std::chrono::duration_cast< std::chrono::nanoseconds >( clock_type::now() - start );
+}
+
+// Tasks posted by a thread outside of the pool, from the first post until all of them are finished
+void run_throughput( thread_pool& pool, record& r, size_t tasks )
+{
+    const size_t size{ r.task_size };
+    const auto start = clock_type::now();
+
+    for( size_t i{ 0 }; i < tasks; ++i )
+    {
+        pool.post( [ size ](){ burn( size ); } );
+    }
+
+    pool.wait_until_finished();
+
+    r.operations = tasks;
+    r.elapsed = since( start );
+}
+
+// Submission alone, the time the producers spend in post
+void run_submit( thread_pool& pool, record& r, size_t tasks )
+{
+    const size_t size{ r.task_size };
+    const size_t producers{ r.producers };
+    const size_t per_producer{ tasks / producers };
+
+    auto submit = [ &pool, size, per_producer ]()
+    {
+        for( size_t i{ 0 }; i < per_producer; ++i )
+        {
+            pool.post( [ size ](){ burn( size ); } );
+        }
+    };
+
+    if( producers == 1 )
+    {
+        const auto start = clock_type::now();
+        submit();
+        r.elapsed = since( start );
+    }
+    else
+    {
+        std::atomic_bool go{ false };
+        std::vector< std::thread > threads;
+
+        for( size_t i{ 0 }; i < producers; ++i )
+        {
+            threads.emplace_back( [ &go, &submit ]()
+            {
+                while( !go )
+                {
+                    std::this_thread::yield();
+                }
+
+                submit();
+            } );
+        }
+
+        const auto start = clock_type::now();
+        go = true;
+
+        for( auto& thread : threads )
+        {
+            thread.join();
+        }
+
+        r.elapsed = since( start );
+    }
+
+    r.operations = per_producer * producers;
+    pool.wait_until_finished();
+}
+
+// A round submits fan_out tasks and waits for all their futures
+void run_fan_out( thread_pool& pool, record& r, size_t rounds, size_t fan_out )
+{
+    const size_t size{ r.task_size };
+    std::vector< std::future< void > > results;
+    results.reserve( fan_out );
+
+    r.latencies.reserve( rounds );
+    const auto start = clock_type::now();
+
+    for( size_t round{ 0 }; round < rounds; ++round )
+    {
+        const auto round_start = clock_type::now();
+
+        for( size_t i{ 0 }; i < fan_out; ++i )
+        {
+            results.emplace_back( pool.add_task( [ size ](){ burn( size ); } ) );
+        }
+
+        for( auto& result : results )
+        {
+            result.get();
+        }
+
+        r.latencies.emplace_back( since( round_start ) );
+        results.clear();
+    }
+
+    r.operations = rounds;
+    r.elapsed = since( start );
+}
+
+// Latency of wait_until_finished, on an idle pool when idle is true, otherwise right after posting a single task
+void run_wait( thread_pool& pool, record& r, size_t rounds, bool idle )
+{
+    const size_t size{ r.task_size };
+
+    r.latencies.reserve( rounds );
+    const auto start = clock_type::now();
+
+    for( size_t round{ 0 }; round < rounds; ++round )
+    {
+        if( !idle )
+        {
+            pool.post( [ size ](){ burn( size ); } );
+        }
+
+        const auto wait_start = clock_type::now();
+        pool.wait_until_finished();
+        r.latencies.emplace_back( since( wait_start ) );
+    }
+
+    r.operations = rounds;
+    r.elapsed = since( start );
+}
+
+std::chrono::nanoseconds percentile( const std::vector< std::chrono::nanoseconds >& sorted, double q )
+{
+    const size_t index{ static_cast< size_t >( q * static_cast< double >( sorted.size() - 1 ) + 0.5 ) };
+    return sorted[ std::min( index, sorted.size() - 1 ) ];
+}
+
+const char* policy_name( scheduling_policy policy )
+{
+    return policy == scheduling_policy::shared_queue ? "shared_queue" : "work_stealing";
+}
+
+const char* backend_name( queue_backend backend )
+{
+    return backend == queue_backend::locked ? "locked" : "lock_free";
+}
+
+fields to_fields( const options& o, record& r )
+{
+    fields result{ text_field( "scenario", r.scenario ),
+                   text_field( "policy", policy_name( o.policy ) ),
+                   text_field( "backend", backend_name( o.backend ) ),
+                   number_field( "workers", r.workers ),
+                   number_field( "producers", r.producers ),
+                   number_field( "task_size", r.task_size ),
+                   number_field( "repetition", r.repetition ),
+                   number_field( "operations", r.operations ),
+                   number_field( "elapsed_ns", r.elapsed.count() ),
+                   number_field( "ops_per_sec", static_cast< uint64_t >( rate( r.operations, r.elapsed ) ) ) };
+
+    if( r.latencies.empty() )
+    {
+        for( const char* name : { "latency_mean_ns", "latency_p50_ns", "latency_p99_ns", "latency_max_ns" } )
+        {
+            result.emplace_back( empty_field( name ) );
+        }
+
+        return result;
+    }
+
+    std::sort( r.latencies.begin(), r.latencies.end() );
+
+    std::chrono::nanoseconds sum{ 0 };
+    for( const auto& latency : r.latencies )
+    {
+        sum += latency;
+    }
+
+    result.emplace_back( number_field( "latency_mean_ns", sum.count() / static_cast< std::chrono::nanoseconds::rep >( r.latencies.size() ) ) );
+    result.emplace_back( number_field( "latency_p50_ns", percentile( r.latencies, 0.5 ).count() ) );
+    result.emplace_back( number_field( "latency_p99_ns", percentile( r.latencies, 0.99 ).count() ) );
+    result.emplace_back( number_field( "latency_max_ns", r.latencies.back().count() ) );
+
+    return result;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+    options o;
+
+    try
+    {
+        o = parse_options( argc, argv );
+    }
+    catch( const std::exception& e )
+    {
+        std::cerr << e.what() << "\nUsage: thread_pool_benchmark [--workers=1,2,4] [--task-sizes=0,1000] [--tasks=N] [--rounds=N]"
+                                 " [--producers=N] [--fan-out=N] [--repetitions=N] [--policy=shared_queue|work_stealing]"
+                                 " [--backend=locked|lock_free] [--format=csv|json] [--output=file]\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector< record > records;
+
+    for( const size_t workers : o.workers )
+    {
+        thread_pool pool{ workers, o.policy, o.backend };
+
+        // Warm up, so that the workers and the queues' memory are in place before the first measurement
+        for( size_t i{ 0 }; i < workers * 64; ++i )
+        {
+            pool.post( [](){ burn( 100 ); } );
+        }
+
+        pool.wait_until_finished();
+
+        for( const size_t task_size : o.task_sizes )
+        {
+            for( size_t repetition{ 0 }; repetition < o.repetitions; ++repetition )
+            {
+                auto add = [ & ]( const char* scenario, size_t producers ) -> record&
+                {
+                    records.emplace_back();
+
+                    record& r = records.back();
+                    r.scenario = scenario;
+                    r.workers = workers;
+                    r.producers = producers;
+                    r.task_size = task_size;
+                    r.repetition = repetition;
+
+                    return r;
+                };
+
+                run_throughput( pool, add( "throughput", 1 ), o.tasks );
+                run_submit( pool, add( "submit_single_producer", 1 ), o.tasks );
+                run_submit( pool, add( "submit_multi_producer", o.producers ), o.tasks );
+                run_fan_out( pool, add( "fan_out_fan_in", 1 ), o.rounds, o.fan_out );
+                run_wait( pool, add( "wait_idle", 1 ), o.rounds, true );
+                run_wait( pool, add( "wait_single_task", 1 ), o.rounds, false );
+
+                std::cerr << "workers " << workers << ", task size " << task_size << ", repetition " << repetition << " done\n";
+            }
+        }
+    }
+
+    std::vector< fields > output;
+
+    for( auto& r : records )
+    {
+        output.emplace_back( to_fields( o, r ) );
+    }
+
+    return write_output( o, output );
+}
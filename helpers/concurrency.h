@@ -2,6 +2,18 @@
 #define _HELPERS_CONCURRENCY_ALL_H_
 
 #include "concurrency/thread_pool.h"
+#include "concurrency/cancellation.h"
 #include "concurrency/thread_pauser.h"
+#include "concurrency/mpmc_queue.h"
+#include "concurrency/timer_wheel.h"
+#include "concurrency/cpu_topology.h"
+#include "concurrency/task_graph.h"
+#include "concurrency/task_group.h"
+#include "concurrency/strand.h"
+#include "concurrency/pool_future.h"
+#include "concurrency/coroutine_task.h"
+#include "concurrency/pool_scaler.h"
+#include "concurrency/pool_stats.h"
+#include "concurrency/parallel_algorithms.h"
 
 #endif
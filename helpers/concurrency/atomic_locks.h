@@ -3,6 +3,15 @@
 
 #include <chrono>
 #include <atomic>
+#include <thread>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined( _M_IX86 ) || defined( _M_X64 )
+#include <intrin.h>
+#endif
 
 namespace helpers
 {
@@ -10,6 +19,18 @@ namespace helpers
 namespace concurrency
 {
 
+// Hint to the CPU that the thread is spinning, lowers the power usage and the penalty of leaving the loop
+inline void cpu_relax() noexcept
+{
+#if defined( __i386__ ) || defined( __x86_64__ )
+    __builtin_ia32_pause();
+#elif defined( _M_IX86 ) || defined( _M_X64 )
+    _mm_pause();
+#elif defined( __aarch64__ ) || defined( __arm__ )
+    __asm__ __volatile__( "yield" );
+#endif
+}
+
 class spinlock final
 {
 public:
@@ -21,6 +42,38 @@ private:
     std::atomic_flag m_flag{ ATOMIC_FLAG_INIT };
 };
 
+/// \class exponential_backoff
+/// Wait step of a spinning thread: the first pause() spins MinSpins times with cpu_relax(),
+/// each next one twice as long, and once MaxSpins is reached, pause() yields the thread instead
+template< uint32_t MinSpins = 4, uint32_t MaxSpins = 1024 >
+class exponential_backoff
+{
+public:
+    static_assert( MinSpins > 0 && MinSpins <= MaxSpins && MaxSpins <= ( 1u << 30 ), "Invalid number of spins" );
+
+    void pause() noexcept;
+    void reset() noexcept{ m_spins = MinSpins; }
+
+private:
+    uint32_t m_spins{ MinSpins };
+};
+
+/// \class backoff_spinlock
+/// Drop-in replacement for spinlock under contention. Waiters spin on a plain load, which keeps
+/// the cache line shared, and try to take the lock only once it's seen free. Between the loads
+/// they back off exponentially with cpu_relax(), then yield, see exponential_backoff
+template< uint32_t MinSpins = 4, uint32_t MaxSpins = 1024 >
+class backoff_spinlock final
+{
+public:
+    void lock() noexcept;
+    bool try_lock() noexcept;
+    void unlock() noexcept;
+
+private:
+    std::atomic_bool m_locked{ false };
+};
+
 enum class lock_mode{ read, write };
 
 class rw_spinlock final
@@ -44,20 +97,109 @@ private:
     std::atomic_uint_fast32_t m_lock{ 0 };
 };
 
+/// \class fair_rw_spinlock
+/// Phase-fair ticket rw lock ( Brandenburg, Anderson ), drop-in replacement for rw_spinlock.
+/// Reader and writer phases alternate: a writer waits only for the readers admitted before it
+/// and the writers with earlier tickets, readers arriving while a writer is waiting or active
+/// enter right after its phase. Writers are served in the order of their tickets.
+/// A reader is admitted with a single fetch_add, waiting readers spin on a load
+class fair_rw_spinlock final
+{
+public:
+    void lock( const lock_mode& mode ) noexcept;
+    bool try_lock( const lock_mode& mode ) noexcept;
+    void unlock( const lock_mode& mode ) noexcept;
+
+private:
+    void lock_read() noexcept;
+    bool try_lock_read() noexcept;
+
+    void lock_write() noexcept;
+    bool try_lock_write() noexcept;
+
+    void unlock_read() noexcept;
+    void unlock_write() noexcept;
+
+private:
+    // Readers are counted in the upper bits of m_readers_in and m_readers_out, the lower bits
+    // of m_readers_in hold the presence of a writer and the parity of its ticket
+    static constexpr uint32_t reader_increment{ 0x100 };
+    static constexpr uint32_t writer_bits{ 0x3 };
+    static constexpr uint32_t writer_present{ 0x2 };
+    static constexpr uint32_t writer_phase{ 0x1 };
+
+    std::atomic< uint32_t > m_readers_in{ 0 };
+    std::atomic< uint32_t > m_readers_out{ 0 };
+    std::atomic< uint32_t > m_writers_in{ 0 };
+    std::atomic< uint32_t > m_writers_out{ 0 };
+};
+
+/// \class br_spinlock
+/// Big-reader lock, a drop-in replacement for rw_spinlock for the read-mostly data.
+/// Readers are counted in per-thread slots, each on its own cache line, so that the readers
+/// of different threads don't touch a shared line beyond reading the writer flag.
+/// A writer sets the flag, which stops the new readers, and waits until all slots drain,
+/// so writing costs a pass over all slots. A read lock has to be released by the thread which took it
+class br_spinlock final
+{
+public:
+    static constexpr size_t cache_line_size{ 64 };
+
+    // Number of slots is rounded up to the power of two, threads are spread over them round robin
+    explicit br_spinlock( size_t slots = std::thread::hardware_concurrency() );
+
+    br_spinlock( const br_spinlock& ) = delete;
+    br_spinlock& operator=( const br_spinlock& ) = delete;
+
+    void lock( const lock_mode& mode ) noexcept;
+    bool try_lock( const lock_mode& mode ) noexcept;
+    void unlock( const lock_mode& mode ) noexcept;
+
+    size_t slots() const noexcept{ return m_mask + 1; }
+
+private:
+    struct slot
+    {
+        std::atomic< uint32_t > readers{ 0 };
+        char padding[ cache_line_size - sizeof( std::atomic< uint32_t > ) ];
+    };
+
+    slot& current_slot() const noexcept;
+
+    void lock_read() noexcept;
+    bool try_lock_read() noexcept;
+
+    void lock_write() noexcept;
+    bool try_lock_write() noexcept;
+
+    void unlock_read() noexcept;
+    void unlock_write() noexcept;
+
+    static size_t round_slots( size_t slots ) noexcept;
+
+private:
+    const size_t m_mask;
+    const std::unique_ptr< slot[] > m_slots;
+    std::atomic_bool m_writer{ false };
+};
+
 enum class lock_policy{ instant, defer };
 
-class rw_spinlock_guard
+/// \class basic_rw_spinlock_guard
+/// Owner of a lock mode of rw_spinlock or a lock with the same interface
+template< typename RwLock >
+class basic_rw_spinlock_guard
 {
 public:
-    explicit rw_spinlock_guard( rw_spinlock& lock,
-                                const lock_mode& mode,
-                                const lock_policy& policy = lock_policy::instant ) noexcept;
+    explicit basic_rw_spinlock_guard( RwLock& lock,
+                                      const lock_mode& mode,
+                                      const lock_policy& policy = lock_policy::instant ) noexcept;
 
-    rw_spinlock_guard( const rw_spinlock_guard& ) = delete;
-    rw_spinlock_guard( rw_spinlock_guard&& ) = delete;
-    rw_spinlock_guard& operator=(const rw_spinlock_guard&) = delete;
-    rw_spinlock_guard& operator=( rw_spinlock_guard&& ) = delete;
-    ~rw_spinlock_guard();
+    basic_rw_spinlock_guard( const basic_rw_spinlock_guard& ) = delete;
+    basic_rw_spinlock_guard( basic_rw_spinlock_guard&& ) = delete;
+    basic_rw_spinlock_guard& operator=(const basic_rw_spinlock_guard&) = delete;
+    basic_rw_spinlock_guard& operator=( basic_rw_spinlock_guard&& ) = delete;
+    ~basic_rw_spinlock_guard();
 
     void lock() noexcept;
     bool try_lock() noexcept;
@@ -99,11 +241,278 @@ public:
     void release() noexcept;
 
 private:
-    rw_spinlock& m_lock;
+    RwLock& m_lock;
     lock_mode m_mode;
     std::atomic_bool m_owns_lock{ false };
 };
 
+using rw_spinlock_guard = basic_rw_spinlock_guard< rw_spinlock >;
+using fair_rw_spinlock_guard = basic_rw_spinlock_guard< fair_rw_spinlock >;
+using br_spinlock_guard = basic_rw_spinlock_guard< br_spinlock >;
+
+/// \class seqlock
+/// Sequence lock over a small trivially copyable value, which is read far more often than written.
+/// Readers don't write to the shared memory at all: they copy the value between two reads of the
+/// sequence and retry if a writer was active meanwhile, so they never block the writers, but may
+/// retry under frequent writes. Writers exclude each other by keeping the sequence odd while writing.
+/// The value is stored as words of atomics, so that the racing copies of readers are well defined
+template< typename T >
+class seqlock final
+{
+    static_assert( std::is_trivially_copyable< T >::value, "Value should be trivially copyable" );
+    static_assert( std::is_default_constructible< T >::value, "Value should be default constructible" );
+
+public:
+    explicit seqlock( const T& value = T{} ) noexcept;
+
+    seqlock( const seqlock& ) = delete;
+    seqlock& operator=( const seqlock& ) = delete;
+
+    T load() const noexcept;
+
+    // Single attempt, returns false if a writer was active
+    bool try_load( T& value ) const noexcept;
+
+    void store( const T& value ) noexcept;
+
+    // Read-modify-write as func( T& ) under the writer side. If func throws, the value is left unchanged
+    template< typename Func >
+    void update( Func&& func );
+
+private:
+    static constexpr size_t word_count{ ( sizeof( T ) + sizeof( size_t ) - 1 ) / sizeof( size_t ) };
+
+    size_t lock_write() noexcept;
+    void unlock_write( size_t sequence ) noexcept;
+
+    T read_words() const noexcept;
+    void write_words( const T& value ) noexcept;
+
+private:
+    std::atomic< size_t > m_sequence{ 0 };
+    std::atomic< size_t > m_words[ word_count ];
+};
+
+///// implementation
+
+template< uint32_t MinSpins, uint32_t MaxSpins >
+void exponential_backoff< MinSpins, MaxSpins >::pause() noexcept
+{
+    if( m_spins > MaxSpins )
+    {
+        std::this_thread::yield();
+        return;
+    }
+
+    for( uint32_t i{ 0 }; i < m_spins; ++i )
+    {
+        cpu_relax();
+    }
+
+    m_spins *= 2;
+}
+
+template< uint32_t MinSpins, uint32_t MaxSpins >
+void backoff_spinlock< MinSpins, MaxSpins >::lock() noexcept
+{
+    exponential_backoff< MinSpins, MaxSpins > backoff;
+
+    while( m_locked.exchange( true, std::memory_order_acquire ) )
+    {
+        do
+        {
+            backoff.pause();
+        }
+        while( m_locked.load( std::memory_order_relaxed ) );
+    }
+}
+
+template< uint32_t MinSpins, uint32_t MaxSpins >
+bool backoff_spinlock< MinSpins, MaxSpins >::try_lock() noexcept
+{
+    return !m_locked.load( std::memory_order_relaxed ) && !m_locked.exchange( true, std::memory_order_acquire );
+}
+
+template< uint32_t MinSpins, uint32_t MaxSpins >
+void backoff_spinlock< MinSpins, MaxSpins >::unlock() noexcept
+{
+    m_locked.store( false, std::memory_order_release );
+}
+
+template< typename RwLock >
+basic_rw_spinlock_guard< RwLock >::basic_rw_spinlock_guard( RwLock& lock, const lock_mode& mode, const lock_policy& policy ) noexcept :
+    m_lock( lock ),
+    m_mode( mode )
+{
+    if( policy == lock_policy::instant )
+    {
+        this->lock();
+    }
+}
+
+template< typename RwLock >
+basic_rw_spinlock_guard< RwLock >::~basic_rw_spinlock_guard()
+{
+    if( m_owns_lock )
+    {
+        m_lock.unlock( m_mode );
+    }
+}
+
+template< typename RwLock >
+void basic_rw_spinlock_guard< RwLock >::lock() noexcept
+{
+    m_lock.lock( m_mode );
+    m_owns_lock = true;
+}
+
+template< typename RwLock >
+bool basic_rw_spinlock_guard< RwLock >::try_lock() noexcept
+{
+    m_owns_lock = m_lock.try_lock( m_mode );
+    return m_owns_lock;
+}
+
+template< typename RwLock >
+void basic_rw_spinlock_guard< RwLock >::unlock() noexcept
+{
+    m_lock.unlock( m_mode );
+    m_owns_lock = false;
+}
+
+template< typename RwLock >
+void basic_rw_spinlock_guard< RwLock >::release() noexcept
+{
+    m_owns_lock = false;
+}
+
+template< typename T >
+constexpr size_t seqlock< T >::word_count;
+
+template< typename T >
+seqlock< T >::seqlock( const T& value ) noexcept
+{
+    write_words( value );
+}
+
+template< typename T >
+T seqlock< T >::load() const noexcept
+{
+    T value;
+    exponential_backoff<> backoff;
+
+    while( !try_load( value ) )
+    {
+        backoff.pause();
+    }
+
+    return value;
+}
+
+template< typename T >
+bool seqlock< T >::try_load( T& value ) const noexcept
+{
+    const size_t before{ m_sequence.load( std::memory_order_acquire ) };
+
+    if( before & 1 )
+    {
+        return false;
+    }
+
+    const T copy{ read_words() };
+
+    // Pairs with the writer's release fence: if any word of a newer write was read, so is its odd sequence
+    std::atomic_thread_fence( std::memory_order_acquire );
+
+    if( m_sequence.load( std::memory_order_relaxed ) != before )
+    {
+        return false;
+    }
+
+    value = copy;
+    return true;
+}
+
+template< typename T >
+void seqlock< T >::store( const T& value ) noexcept
+{
+    const size_t sequence{ lock_write() };
+    write_words( value );
+    unlock_write( sequence );
+}
+
+template< typename T >
+template< typename Func >
+void seqlock< T >::update( Func&& func )
+{
+    const size_t sequence{ lock_write() };
+    T value{ read_words() };
+
+    try
+    {
+        func( value );
+    }
+    catch( ... )
+    {
+        unlock_write( sequence );
+        throw;
+    }
+
+    write_words( value );
+    unlock_write( sequence );
+}
+
+template< typename T >
+size_t seqlock< T >::lock_write() noexcept
+{
+    exponential_backoff<> backoff;
+    size_t sequence{ m_sequence.load( std::memory_order_relaxed ) };
+
+    while( ( sequence & 1 ) || !m_sequence.compare_exchange_weak( sequence, sequence + 1, std::memory_order_acquire,
+                                                                                        std::memory_order_relaxed ) )
+    {
+        backoff.pause();
+        sequence = m_sequence.load( std::memory_order_relaxed );
+    }
+
+    // The odd sequence is visible before any of the words written after it
+    std::atomic_thread_fence( std::memory_order_release );
+
+    return sequence + 1;
+}
+
+template< typename T >
+void seqlock< T >::unlock_write( size_t sequence ) noexcept
+{
+    m_sequence.store( sequence + 1, std::memory_order_release );
+}
+
+template< typename T >
+T seqlock< T >::read_words() const noexcept
+{
+    size_t words[ word_count ];
+    for( size_t i{ 0 }; i < word_count; ++i )
+    {
+        words[ i ] = m_words[ i ].load( std::memory_order_relaxed );
+    }
+
+    T value;
+    std::memcpy( &value, words, sizeof( T ) );
+    return value;
+}
+
+template< typename T >
+void seqlock< T >::write_words( const T& value ) noexcept
+{
+    size_t words[ word_count ]{};
+    std::memcpy( words, &value, sizeof( T ) );
+
+    for( size_t i{ 0 }; i < word_count; ++i )
+    {
+        m_words[ i ].store( words[ i ], std::memory_order_relaxed );
+    }
+}
+
 }// concurrency
 
 }// helpers
@@ -0,0 +1,107 @@
+#ifndef HELPERS_CANCELLATION
+#define HELPERS_CANCELLATION
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+// Result of a task cancelled before it was started, thrown by cancellation_token::throw_if_cancellation_requested
+class task_cancelled : public std::runtime_error
+{
+public:
+    task_cancelled() : std::runtime_error{ "Task was cancelled" }{}
+};
+
+/// \class cancellation_token
+/// Observer of a cancellation_source's state, cheap to copy and to poll.
+/// Default constructed token is never cancelled
+class cancellation_token
+{
+public:
+    cancellation_token() noexcept = default;
+
+    bool is_cancellation_requested() const noexcept{ return m_state && m_state->load( std::memory_order_acquire ); }
+    bool can_be_cancelled() const noexcept{ return m_state != nullptr; }
+
+    // Throws task_cancelled if cancellation was requested
+    void throw_if_cancellation_requested() const;
+
+private:
+    friend class cancellation_source;
+
+    explicit cancellation_token( std::shared_ptr< const std::atomic_bool > state ) noexcept : m_state( std::move( state ) ){}
+
+private:
+    std::shared_ptr< const std::atomic_bool > m_state;
+};
+
+/// \class cancellation_source
+/// Requests cancellation of all the tasks holding its tokens.
+/// Copies share the same state
+class cancellation_source
+{
+public:
+    cancellation_source();
+
+    cancellation_token token() const noexcept{ return cancellation_token{ m_state }; }
+
+    // Returns true if this call requested cancellation, false if it was already requested
+    bool cancel() noexcept;
+    bool is_cancellation_requested() const noexcept{ return m_state->load( std::memory_order_acquire ); }
+
+private:
+    std::shared_ptr< std::atomic_bool > m_state;
+};
+
+namespace details
+{
+
+/// \class cancellable_task
+/// Callable checking the token right before the call. A cancelled task isn't called:
+/// with Throw it throws task_cancelled to be stored in the task's future,
+/// otherwise does nothing and the callable's result is discarded
+template< typename Callable, bool Throw >
+class cancellable_task
+{
+public:
+    using result_type = typename std::conditional< Throw, typename std::result_of< Callable&() >::type, void >::type;
+
+    cancellable_task( cancellation_token token, Callable&& callable ) :
+        m_token( std::move( token ) ),
+        m_callable( std::move( callable ) )
+    {
+    }
+
+    result_type operator()()
+    {
+        if( m_token.is_cancellation_requested() )
+        {
+            return skip( std::integral_constant< bool, Throw >{} );
+        }
+
+        return static_cast< result_type >( m_callable() );
+    }
+
+private:
+    result_type skip( std::true_type ){ throw task_cancelled{}; }
+    void skip( std::false_type ) noexcept{}
+
+private:
+    cancellation_token m_token;
+    Callable m_callable;
+};
+
+}// details
+
+}// concurrency
+
+}// helpers
+
+#endif
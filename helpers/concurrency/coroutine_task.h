@@ -0,0 +1,260 @@
+#ifndef HELPERS_COROUTINE_TASK
+#define HELPERS_COROUTINE_TASK
+
+#include "thread_pool.h"
+
+#ifdef HELPERS_HAS_COROUTINES
+
+#include <future>
+#include <utility>
+#include <optional>
+#include <exception>
+#include <coroutine>
+#include <type_traits>
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+template< typename T = void >
+class task;
+
+namespace details
+{
+
+/// \class task_promise_base
+/// Promise part common to all task results. The coroutine starts suspended and
+/// resumes the coroutine awaiting it right from its final suspension point
+class task_promise_base
+{
+public:
+    struct final_awaiter
+    {
+        bool await_ready() const noexcept{ return false; }
+
+        template< typename Promise >
+        std::coroutine_handle<> await_suspend( std::coroutine_handle< Promise > coroutine ) noexcept
+        {
+            auto continuation = coroutine.promise().m_continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept{}
+    };
+
+    std::suspend_always initial_suspend() const noexcept{ return {}; }
+    final_awaiter final_suspend() const noexcept{ return {}; }
+
+    void unhandled_exception() noexcept{ m_error = std::current_exception(); }
+
+    void set_continuation( std::coroutine_handle<> continuation ) noexcept{ m_continuation = continuation; }
+
+protected:
+    void check_error() const
+    {
+        if( m_error )
+        {
+            std::rethrow_exception( m_error );
+        }
+    }
+
+private:
+    std::coroutine_handle<> m_continuation;
+    std::exception_ptr m_error;
+};
+
+template< typename T >
+class task_promise : public task_promise_base
+{
+public:
+    task< T > get_return_object() noexcept;
+
+    template< typename Value >
+    void return_value( Value&& value ){ m_value.emplace( std::forward< Value >( value ) ); }
+
+    T result()
+    {
+        check_error();
+        return std::move( *m_value );
+    }
+
+private:
+    std::optional< T > m_value;
+};
+
+template<>
+class task_promise< void > : public task_promise_base
+{
+public:
+    task< void > get_return_object() noexcept;
+
+    void return_void() const noexcept{}
+
+    void result() const{ check_error(); }
+};
+
+// Coroutine owning its frame, started right away and destroyed once finished
+struct detached_coroutine
+{
+    struct promise_type
+    {
+        detached_coroutine get_return_object() const noexcept{ return {}; }
+        std::suspend_never initial_suspend() const noexcept{ return {}; }
+        std::suspend_never final_suspend() const noexcept{ return {}; }
+        void return_void() const noexcept{}
+        void unhandled_exception() const noexcept{ std::terminate(); }
+    };
+};
+
+}// details
+
+/// \class task
+/// Lazily started coroutine producing a T. The task starts when it's awaited with co_await,
+/// which suspends the awaiting coroutine until the task is finished without blocking the thread.
+/// A task runs in the thread it was resumed in, co_await thread_pool::schedule() moves it to the pool
+template< typename T >
+class task
+{
+public:
+    static_assert( !std::is_reference< T >::value, "Task of a reference is not supported" );
+
+    using promise_type = details::task_promise< T >;
+    using value_type = T;
+
+    task() noexcept = default;
+    task( task&& other ) noexcept : m_coroutine( std::exchange( other.m_coroutine, nullptr ) ){}
+
+    task& operator=( task&& other ) noexcept
+    {
+        if( this != &other )
+        {
+            reset();
+            m_coroutine = std::exchange( other.m_coroutine, nullptr );
+        }
+
+        return *this;
+    }
+
+    task( const task& ) = delete;
+    task& operator=( const task& ) = delete;
+
+    ~task(){ reset(); }
+
+    bool valid() const noexcept{ return static_cast< bool >( m_coroutine ); }
+    bool is_ready() const noexcept{ return m_coroutine && m_coroutine.done(); }
+
+    // Start the task and wait for its result, rethrow its exception.
+    // Throws std::future_error with no_state if the task is empty
+    auto operator co_await() && noexcept;
+
+private:
+    friend class details::task_promise< T >;
+
+    explicit task( std::coroutine_handle< promise_type > coroutine ) noexcept : m_coroutine( coroutine ){}
+
+    void reset() noexcept
+    {
+        if( m_coroutine )
+        {
+            std::exchange( m_coroutine, nullptr ).destroy();
+        }
+    }
+
+private:
+    std::coroutine_handle< promise_type > m_coroutine;
+};
+
+// Start the task in the pool, return future of its result
+template< typename T >
+std::future< T > spawn( thread_pool& pool, task< T > t );
+
+///// implementation
+
+namespace details
+{
+
+template< typename T >
+task< T > task_promise< T >::get_return_object() noexcept
+{
+    return task< T >{ std::coroutine_handle< task_promise< T > >::from_promise( *this ) };
+}
+
+inline task< void > task_promise< void >::get_return_object() noexcept
+{
+    return task< void >{ std::coroutine_handle< task_promise< void > >::from_promise( *this ) };
+}
+
+template< typename T >
+detached_coroutine run_detached( thread_pool& pool, task< T > t, std::promise< T > promise )
+{
+    try
+    {
+        co_await pool.schedule();
+
+        if constexpr( std::is_void< T >::value )
+        {
+            co_await std::move( t );
+            promise.set_value();
+        }
+        else
+        {
+            promise.set_value( co_await std::move( t ) );
+        }
+    }
+    catch( ... )
+    {
+        promise.set_exception( std::current_exception() );
+    }
+}
+
+}// details
+
+template< typename T >
+auto task< T >::operator co_await() && noexcept
+{
+    struct awaiter
+    {
+        std::coroutine_handle< promise_type > coroutine;
+
+        bool await_ready() const noexcept{ return !coroutine || coroutine.done(); }
+
+        std::coroutine_handle<> await_suspend( std::coroutine_handle<> awaiting ) noexcept
+        {
+            coroutine.promise().set_continuation( awaiting );
+            return coroutine;
+        }
+
+        T await_resume()
+        {
+            if( !coroutine )
+            {
+                throw std::future_error{ std::future_errc::no_state };
+            }
+
+            return coroutine.promise().result();
+        }
+    };
+
+    return awaiter{ m_coroutine };
+}
+
+template< typename T >
+std::future< T > spawn( thread_pool& pool, task< T > t )
+{
+    std::promise< T > promise;
+    auto result = promise.get_future();
+
+    details::run_detached( pool, std::move( t ), std::move( promise ) );
+
+    return result;
+}
+
+}// concurrency
+
+}// helpers
+
+#endif
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef HELPERS_CPU_TOPOLOGY
+#define HELPERS_CPU_TOPOLOGY
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+/// \class cpu_topology
+/// CPUs available to the process grouped by NUMA nodes.
+/// On Linux it's read from /sys/devices/system/node, elsewhere all the CPUs make a single node
+class cpu_topology
+{
+public:
+    struct node
+    {
+        // System id of the node
+        size_t id;
+        std::vector< size_t > cpus;
+    };
+
+    // Nodes without CPUs are skipped. Throws std::invalid_argument if there are no CPUs at all
+    explicit cpu_topology( std::vector< node > nodes );
+
+    // Topology of the current machine, read once
+    static const cpu_topology& system();
+
+    const std::vector< node >& nodes() const noexcept{ return m_nodes; }
+    size_t nodes_number() const noexcept{ return m_nodes.size(); }
+    size_t cpus_number() const noexcept;
+
+    // Index of the node in nodes() the CPU belongs to, nodes_number() if none
+    size_t node_of( size_t cpu ) const noexcept;
+
+    // Parse a CPU list in the sysfs format, like "0-3,8,10-11"
+    static std::vector< size_t > parse_cpu_list( const std::string& list );
+
+private:
+    std::vector< node > m_nodes;
+};
+
+// Pin the calling thread to the CPUs. Returns false if it failed or isn't supported on the platform
+bool set_current_thread_affinity( const std::vector< size_t >& cpus );
+
+}// concurrency
+
+}// helpers
+
+#endif
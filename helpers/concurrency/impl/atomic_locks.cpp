@@ -87,65 +87,258 @@ void rw_spinlock::unlock_read() noexcept
 {
     assert( m_lock & 0x7fffffff );
 
-    while( true )
+    // Release, so that the reader's accesses can't leak past the following writer's lock
+    m_lock.fetch_sub( 1, std::memory_order_release );
+}
+
+void rw_spinlock::unlock_write() noexcept
+{
+    assert( m_lock == 0x80000000 );
+    m_lock = 0;
+}
+
+//
+
+constexpr uint32_t fair_rw_spinlock::reader_increment;
+constexpr uint32_t fair_rw_spinlock::writer_bits;
+constexpr uint32_t fair_rw_spinlock::writer_present;
+constexpr uint32_t fair_rw_spinlock::writer_phase;
+
+void fair_rw_spinlock::lock( const lock_mode& mode ) noexcept
+{
+    return mode == lock_mode::read? lock_read() : lock_write();
+}
+
+bool fair_rw_spinlock::try_lock( const lock_mode& mode ) noexcept
+{
+    return mode == lock_mode::read? try_lock_read() : try_lock_write();
+}
+
+void fair_rw_spinlock::unlock( const lock_mode& mode ) noexcept
+{
+    return mode == lock_mode::read? unlock_read() : unlock_write();
+}
+
+void fair_rw_spinlock::lock_read() noexcept
+{
+    const uint32_t writer{ m_readers_in.fetch_add( reader_increment, std::memory_order_acquire ) & writer_bits };
+
+    // Blocked only by the writer present on admission, until its phase is over
+    if( writer )
     {
-        uint_fast32_t old_lock{ m_lock };
-        uint_fast32_t new_lock{ m_lock - 1 };
+        exponential_backoff<> backoff;
 
-        if( m_lock.compare_exchange_weak( old_lock, new_lock, std::memory_order_acquire ) )
+        while( ( m_readers_in.load( std::memory_order_acquire ) & writer_bits ) == writer )
         {
-            return;
+            backoff.pause();
         }
     }
 }
 
-void rw_spinlock::unlock_write() noexcept
+bool fair_rw_spinlock::try_lock_read() noexcept
 {
-    assert( m_lock == 0x80000000 );
-    m_lock = 0;
+    uint32_t readers{ m_readers_in.load( std::memory_order_relaxed ) };
+
+    return !( readers & writer_bits ) &&
+           m_readers_in.compare_exchange_strong( readers, readers + reader_increment, std::memory_order_acquire );
+}
+
+void fair_rw_spinlock::lock_write() noexcept
+{
+    const uint32_t ticket{ m_writers_in.fetch_add( 1, std::memory_order_relaxed ) };
+    exponential_backoff<> backoff;
+
+    while( m_writers_out.load( std::memory_order_acquire ) != ticket )
+    {
+        backoff.pause();
+    }
+
+    // Stops the new readers, then waits for the ones admitted before
+    const uint32_t readers{ m_readers_in.fetch_add( writer_present | ( ticket & writer_phase ), std::memory_order_acquire ) };
+    backoff.reset();
+
+    while( m_readers_out.load( std::memory_order_acquire ) != readers )
+    {
+        backoff.pause();
+    }
+}
+
+bool fair_rw_spinlock::try_lock_write() noexcept
+{
+    uint32_t ticket{ m_writers_out.load( std::memory_order_relaxed ) };
+
+    if( !m_writers_in.compare_exchange_strong( ticket, ticket + 1, std::memory_order_acquire ) )
+    {
+        return false;
+    }
+
+    // Readers are the same if the upper bits of m_readers_in didn't change
+    uint32_t readers{ m_readers_out.load( std::memory_order_acquire ) };
+
+    if( m_readers_in.compare_exchange_strong( readers, readers | writer_present | ( ticket & writer_phase ), std::memory_order_acquire ) )
+    {
+        return true;
+    }
+
+    m_writers_out.fetch_add( 1, std::memory_order_release );
+    return false;
+}
+
+void fair_rw_spinlock::unlock_read() noexcept
+{
+    // Release, so that the reader's accesses can't leak past the following writer's lock
+    m_readers_out.fetch_add( reader_increment, std::memory_order_release );
+}
+
+void fair_rw_spinlock::unlock_write() noexcept
+{
+    assert( m_readers_in & writer_present );
+
+    // Readers of the writer's phase go first, then the next writer
+    m_readers_in.fetch_and( ~writer_bits, std::memory_order_release );
+    m_writers_out.fetch_add( 1, std::memory_order_release );
 }
 
 //
 
-rw_spinlock_guard::rw_spinlock_guard( rw_spinlock& lock, const lock_mode& mode, const lock_policy& policy ) noexcept :
-    m_lock( lock ),
-    m_mode( mode )
+namespace
 {
-    if( policy == lock_policy::instant )
+
+// Slot index of the thread, the same for all br_spinlocks
+size_t thread_slot_index() noexcept
+{
+    static std::atomic< size_t > next_index{ 0 };
+    static thread_local const size_t index{ next_index.fetch_add( 1, std::memory_order_relaxed ) };
+
+    return index;
+}
+
+}
+
+constexpr size_t br_spinlock::cache_line_size;
+
+br_spinlock::br_spinlock( size_t slots ) :
+    m_mask( round_slots( slots ) - 1 ),
+    m_slots( new slot[ m_mask + 1 ] )
+{
+}
+
+size_t br_spinlock::round_slots( size_t slots ) noexcept
+{
+    size_t result{ 1 };
+
+    while( result < slots )
+    {
+        result <<= 1;
+    }
+
+    return result;
+}
+
+br_spinlock::slot& br_spinlock::current_slot() const noexcept
+{
+    return m_slots[ thread_slot_index() & m_mask ];
+}
+
+void br_spinlock::lock( const lock_mode& mode ) noexcept
+{
+    return mode == lock_mode::read? lock_read() : lock_write();
+}
+
+bool br_spinlock::try_lock( const lock_mode& mode ) noexcept
+{
+    return mode == lock_mode::read? try_lock_read() : try_lock_write();
+}
+
+void br_spinlock::unlock( const lock_mode& mode ) noexcept
+{
+    return mode == lock_mode::read? unlock_read() : unlock_write();
+}
+
+void br_spinlock::lock_read() noexcept
+{
+    // Readers back off while there's a writer, so that a stream of readers doesn't starve it
+    while( !try_lock_read() )
     {
-        this->lock();
+        exponential_backoff<> backoff;
+
+        while( m_writer.load( std::memory_order_relaxed ) )
+        {
+            backoff.pause();
+        }
     }
 }
 
-rw_spinlock_guard::~rw_spinlock_guard()
+bool br_spinlock::try_lock_read() noexcept
 {
-    if( m_owns_lock )
+    auto& readers = current_slot().readers;
+
+    // Sequentially consistent, pairs with lock_write: either the writer sees the reader or the reader sees the writer
+    readers.fetch_add( 1, std::memory_order_seq_cst );
+
+    if( !m_writer.load( std::memory_order_seq_cst ) )
     {
-        m_lock.unlock( m_mode );
+        return true;
     }
+
+    readers.fetch_sub( 1, std::memory_order_release );
+    return false;
 }
 
-void rw_spinlock_guard::lock() noexcept
+void br_spinlock::lock_write() noexcept
 {
-    m_lock.lock( m_mode );
-    m_owns_lock = true;
+    exponential_backoff<> backoff;
+
+    while( m_writer.exchange( true, std::memory_order_seq_cst ) )
+    {
+        while( m_writer.load( std::memory_order_relaxed ) )
+        {
+            backoff.pause();
+        }
+    }
+
+    backoff.reset();
+
+    for( size_t i{ 0 }; i <= m_mask; ++i )
+    {
+        while( m_slots[ i ].readers.load( std::memory_order_seq_cst ) )
+        {
+            backoff.pause();
+        }
+    }
 }
 
-bool rw_spinlock_guard::try_lock() noexcept
+bool br_spinlock::try_lock_write() noexcept
 {
-    m_owns_lock = m_lock.try_lock( m_mode );
-    return m_owns_lock;
+    if( m_writer.load( std::memory_order_relaxed ) || m_writer.exchange( true, std::memory_order_seq_cst ) )
+    {
+        return false;
+    }
+
+    for( size_t i{ 0 }; i <= m_mask; ++i )
+    {
+        if( m_slots[ i ].readers.load( std::memory_order_seq_cst ) )
+        {
+            m_writer.store( false, std::memory_order_release );
+            return false;
+        }
+    }
+
+    return true;
 }
 
-void rw_spinlock_guard::unlock() noexcept
+void br_spinlock::unlock_read() noexcept
 {
-    m_lock.unlock( m_mode );
-    m_owns_lock = false;
+    assert( current_slot().readers.load( std::memory_order_relaxed ) );
+
+    // Release, so that the reader's accesses can't leak past the following writer's lock
+    current_slot().readers.fetch_sub( 1, std::memory_order_release );
 }
 
-void rw_spinlock_guard::release() noexcept
+void br_spinlock::unlock_write() noexcept
 {
-    m_owns_lock = false;
+    assert( m_writer.load( std::memory_order_relaxed ) );
+    m_writer.store( false, std::memory_order_release );
 }
 
 }// concurrency
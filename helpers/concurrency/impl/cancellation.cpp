@@ -0,0 +1,29 @@
+#include "cancellation.h"
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+void cancellation_token::throw_if_cancellation_requested() const
+{
+    if( is_cancellation_requested() )
+    {
+        throw task_cancelled{};
+    }
+}
+
+cancellation_source::cancellation_source() :
+    m_state( std::make_shared< std::atomic_bool >( false ) )
+{
+}
+
+bool cancellation_source::cancel() noexcept
+{
+    return !m_state->exchange( true, std::memory_order_acq_rel );
+}
+
+}// concurrency
+
+}// helpers
@@ -0,0 +1,221 @@
+#include "cpu_topology.h"
+
+#include <thread>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#include <pthread.h>
+#endif
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+namespace
+{
+
+// CPUs the process is allowed to run on
+std::vector< size_t > allowed_cpus()
+{
+    std::vector< size_t > result;
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO( &set );
+
+    if( !sched_getaffinity( 0, sizeof( set ), &set ) )
+    {
+        for( size_t cpu{ 0 }; cpu < CPU_SETSIZE; ++cpu )
+        {
+            if( CPU_ISSET( cpu, &set ) )
+            {
+                result.emplace_back( cpu );
+            }
+        }
+    }
+#endif
+
+    if( result.empty() )
+    {
+        const size_t cpus{ std::max( std::thread::hardware_concurrency(), 1u ) };
+
+        for( size_t cpu{ 0 }; cpu < cpus; ++cpu )
+        {
+            result.emplace_back( cpu );
+        }
+    }
+
+    return result;
+}
+
+std::vector< cpu_topology::node > read_nodes( const std::vector< size_t >& allowed )
+{
+    std::vector< cpu_topology::node > nodes;
+
+#ifdef __linux__
+    const std::string root{ "/sys/devices/system/node/" };
+
+    if( DIR* dir = opendir( root.c_str() ) )
+    {
+        while( dirent* entry = readdir( dir ) )
+        {
+            const std::string name{ entry->d_name };
+
+            if( name.size() <= 4 || name.compare( 0, 4, "node" ) ||
+                !std::all_of( name.begin() + 4, name.end(), []( char c ){ return c >= '0' && c <= '9'; } ) )
+            {
+                continue;
+            }
+
+            std::ifstream file{ root + name + "/cpulist" };
+            std::string list;
+
+            if( !std::getline( file, list ) )
+            {
+                continue;
+            }
+
+            cpu_topology::node n{ static_cast< size_t >( std::strtoul( name.c_str() + 4, nullptr, 10 ) ), {} };
+
+            for( auto cpu : cpu_topology::parse_cpu_list( list ) )
+            {
+                if( std::binary_search( allowed.begin(), allowed.end(), cpu ) )
+                {
+                    n.cpus.emplace_back( cpu );
+                }
+            }
+
+            nodes.emplace_back( std::move( n ) );
+        }
+
+        closedir( dir );
+    }
+
+    std::sort( nodes.begin(), nodes.end(), []( const cpu_topology::node& l, const cpu_topology::node& r ){ return l.id < r.id; } );
+#endif
+
+    const bool has_cpus{ std::any_of( nodes.begin(), nodes.end(), []( const cpu_topology::node& n ){ return !n.cpus.empty(); } ) };
+
+    if( !has_cpus )
+    {
+        nodes.assign( 1, cpu_topology::node{ 0, allowed } );
+    }
+
+    return nodes;
+}
+
+}// anonymous
+
+cpu_topology::cpu_topology( std::vector< node > nodes )
+{
+    for( auto& n : nodes )
+    {
+        if( !n.cpus.empty() )
+        {
+            m_nodes.emplace_back( std::move( n ) );
+        }
+    }
+
+    if( m_nodes.empty() )
+    {
+        throw std::invalid_argument{ "Topology should contain at least one CPU" };
+    }
+}
+
+const cpu_topology& cpu_topology::system()
+{
+    static const cpu_topology topology{ read_nodes( allowed_cpus() ) };
+    return topology;
+}
+
+size_t cpu_topology::cpus_number() const noexcept
+{
+    size_t result{ 0 };
+
+    for( const auto& n : m_nodes )
+    {
+        result += n.cpus.size();
+    }
+
+    return result;
+}
+
+size_t cpu_topology::node_of( size_t cpu ) const noexcept
+{
+    for( size_t index{ 0 }; index < m_nodes.size(); ++index )
+    {
+        const auto& cpus = m_nodes[ index ].cpus;
+
+        if( std::find( cpus.begin(), cpus.end(), cpu ) != cpus.end() )
+        {
+            return index;
+        }
+    }
+
+    return m_nodes.size();
+}
+
+std::vector< size_t > cpu_topology::parse_cpu_list( const std::string& list )
+{
+    std::vector< size_t > result;
+    std::istringstream stream{ list };
+    std::string range;
+
+    while( std::getline( stream, range, ',' ) )
+    {
+        char* end{ nullptr };
+        const size_t first{ std::strtoul( range.c_str(), &end, 10 ) };
+
+        if( end == range.c_str() )
+        {
+            continue;
+        }
+
+        const size_t last{ *end == '-' ? std::strtoul( end + 1, nullptr, 10 ) : first };
+
+        for( size_t cpu{ first }; cpu <= last; ++cpu )
+        {
+            result.emplace_back( cpu );
+        }
+    }
+
+    return result;
+}
+
+bool set_current_thread_affinity( const std::vector< size_t >& cpus )
+{
+#ifdef __linux__
+    if( cpus.empty() )
+    {
+        return false;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO( &set );
+
+    for( auto cpu : cpus )
+    {
+        if( cpu < CPU_SETSIZE )
+        {
+            CPU_SET( cpu, &set );
+        }
+    }
+
+    return !pthread_setaffinity_np( pthread_self(), sizeof( set ), &set );
+#else
+    return false;
+#endif
+}
+
+}// concurrency
+
+}// helpers
@@ -0,0 +1,134 @@
+#include "pool_scaler.h"
+
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+pool_scaler::pool_scaler( thread_pool& pool, const scaling_options& options ) :
+    m_pool( pool ),
+    m_options( options )
+{
+    if( !m_options.min_workers || m_options.min_workers > m_options.max_workers )
+    {
+        throw std::invalid_argument{ "Workers' bounds should satisfy 0 < min_workers <= max_workers" };
+    }
+
+    if( !m_options.sample_period.count() )
+    {
+        throw std::invalid_argument{ "Sample period should be positive" };
+    }
+
+    const size_t workers{ m_pool.workers_number() };
+
+    if( workers < m_options.min_workers )
+    {
+        m_pool.add_workers( static_cast< uint32_t >( m_options.min_workers - workers ) );
+    }
+    else if( workers > m_options.max_workers )
+    {
+        m_pool.schedule_remove_workers( static_cast< uint32_t >( workers - m_options.max_workers ) );
+    }
+
+    m_last_sample = std::chrono::steady_clock::now();
+    m_last_completed = m_pool.completed_tasks_number();
+
+    m_thread = std::thread{ &pool_scaler::sampling_loop, this };
+}
+
+pool_scaler::~pool_scaler()
+{
+    {
+        std::lock_guard< std::mutex > l{ m_stop_mutex };
+        m_stop = true;
+    }
+
+    m_stop_cv.notify_all();
+    m_thread.join();
+}
+
+void pool_scaler::sampling_loop()
+{
+    std::unique_lock< std::mutex > l{ m_stop_mutex };
+
+    while( !m_stop_cv.wait_for( l, m_options.sample_period, [ this ](){ return m_stop; } ) )
+    {
+        l.unlock();
+
+        // Nothing may escape the thread. The workers may have been removed by the user since they were counted,
+        // the pool may be stopping or a thread can't be created, the step is skipped and the next sample starts over
+        try
+        {
+            sample();
+        }
+        catch( ... ){}
+
+        l.lock();
+    }
+}
+
+void pool_scaler::sample()
+{
+    const auto now = std::chrono::steady_clock::now();
+    const size_t completed{ m_pool.completed_tasks_number() };
+    const double seconds{ std::chrono::duration< double >( now - m_last_sample ).count() };
+    const double throughput{ seconds > 0 ? ( completed - m_last_completed ) / seconds : 0 };
+
+    m_last_sample = now;
+    m_last_completed = completed;
+
+    const size_t workers{ m_pool.workers_number() };
+    const size_t queued{ m_pool.queue_size() };
+    const size_t total{ m_pool.total_tasks_number() };
+    const size_t active{ total > queued ? total - queued : 0 };
+
+    // Smoothed, a single sample is likely to catch the workers between two tasks
+    const double utilization{ workers ? std::min( 1.0, static_cast< double >( active ) / workers ) : 1.0 };
+    m_utilization = 0.75 * m_utilization + 0.25 * utilization;
+
+    // Little's law, nothing finished while there are queued tasks means they wait forever
+    double wait{ 0 };
+    if( queued )
+    {
+        wait = throughput > 0 ? queued / throughput : std::numeric_limits< double >::infinity();
+    }
+
+    const double max_wait{ std::chrono::duration< double >( m_options.max_wait ).count() };
+
+    if( wait > max_wait && workers < m_options.max_workers )
+    {
+        m_underloaded = 0;
+
+        if( ++m_overloaded >= m_options.grow_after )
+        {
+            m_overloaded = 0;
+            ++m_grow_count;
+            m_pool.add_workers( static_cast< uint32_t >( std::min( std::max< size_t >( workers, 1 ), m_options.max_workers - workers ) ) );
+        }
+    }
+    else if( !queued && m_utilization < m_options.min_utilization && workers > m_options.min_workers )
+    {
+        m_overloaded = 0;
+
+        if( ++m_underloaded >= m_options.shrink_after )
+        {
+            m_underloaded = 0;
+            ++m_shrink_count;
+            m_pool.schedule_remove_workers( 1 );
+        }
+    }
+    else
+    {
+        m_overloaded = 0;
+        m_underloaded = 0;
+    }
+}
+
+}// concurrency
+
+}// helpers
@@ -0,0 +1,200 @@
+#include "pool_stats.h"
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+namespace
+{
+
+uint64_t to_count( std::chrono::nanoseconds d ) noexcept
+{
+    return d.count() > 0 ? static_cast< uint64_t >( d.count() ) : 0;
+}
+
+}// anonymous
+
+void latency_histogram::add( duration d ) noexcept
+{
+    const uint64_t value{ to_count( d ) };
+
+    ++m_buckets[ bucket_of( d ) ];
+    ++m_count;
+    m_sum += value;
+    m_max = std::max( m_max, value );
+}
+
+void latency_histogram::merge( const latency_histogram& other ) noexcept
+{
+    for( size_t i{ 0 }; i < buckets_number; ++i )
+    {
+        m_buckets[ i ] += other.m_buckets[ i ];
+    }
+
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    m_max = std::max( m_max, other.m_max );
+}
+
+latency_histogram::duration latency_histogram::average() const noexcept
+{
+    return duration{ m_count ? static_cast< duration::rep >( m_sum / m_count ) : 0 };
+}
+
+latency_histogram::duration latency_histogram::percentile( double q ) const noexcept
+{
+    if( !m_count )
+    {
+        return duration{ 0 };
+    }
+
+    const uint64_t rank{ static_cast< uint64_t >( std::ceil( std::min( std::max( q, 0.0 ), 1.0 ) * m_count ) ) };
+    uint64_t seen{ 0 };
+
+    for( size_t i{ 0 }; i < buckets_number; ++i )
+    {
+        seen += m_buckets[ i ];
+
+        if( seen && seen >= rank )
+        {
+            const uint64_t upper{ i + 1 < buckets_number ? ( uint64_t{ 1 } << ( i + 1 ) ) - 1 : m_max };
+            return duration{ static_cast< duration::rep >( std::min( upper, m_max ) ) };
+        }
+    }
+
+    return max();
+}
+
+size_t latency_histogram::bucket_of( duration d ) noexcept
+{
+    uint64_t value{ to_count( d ) };
+
+#ifdef __GNUC__
+    return value > 1 ? 63 - static_cast< size_t >( __builtin_clzll( value ) ) : 0;
+#else
+    size_t bucket{ 0 };
+    while( value >>= 1 )
+    {
+        ++bucket;
+    }
+
+    return bucket;
+#endif
+}
+
+worker_stats& worker_stats::operator+=( const worker_stats& other ) noexcept
+{
+    busy_time += other.busy_time;
+    idle_time += other.idle_time;
+    tasks += other.tasks;
+    steals += other.steals;
+    wakeups += other.wakeups;
+
+    return *this;
+}
+
+auto pool_stats::average_time( pool_metric metric ) const -> sample_type
+{
+    if( !key_present( metric ) )
+    {
+        throw std::out_of_range{ "No samples of the metric" };
+    }
+
+    return histogram( metric ).average();
+}
+
+bool pool_stats::key_present( pool_metric metric ) const noexcept
+{
+    return histogram( metric ).count() != 0;
+}
+
+const latency_histogram& pool_stats::histogram( pool_metric metric ) const noexcept
+{
+    return m_histograms[ static_cast< size_t >( metric ) ];
+}
+
+double pool_stats::utilization() const noexcept
+{
+    const auto total = m_total.busy_time + m_total.idle_time;
+    return total.count() ? static_cast< double >( m_total.busy_time.count() ) / total.count() : 0;
+}
+
+namespace details
+{
+
+void atomic_histogram::add( std::chrono::nanoseconds d ) noexcept
+{
+    const uint64_t value{ to_count( d ) };
+
+    add_relaxed( m_buckets[ latency_histogram::bucket_of( d ) ], 1 );
+    add_relaxed( m_count, 1 );
+    add_relaxed( m_sum, value );
+
+    if( value > m_max.load( std::memory_order_relaxed ) )
+    {
+        m_max.store( value, std::memory_order_relaxed );
+    }
+}
+
+void atomic_histogram::merge_to( latency_histogram& histogram ) const noexcept
+{
+    for( size_t i{ 0 }; i < latency_histogram::buckets_number; ++i )
+    {
+        histogram.m_buckets[ i ] += m_buckets[ i ].load( std::memory_order_relaxed );
+    }
+
+    histogram.m_count += m_count.load( std::memory_order_relaxed );
+    histogram.m_sum += m_sum.load( std::memory_order_relaxed );
+    histogram.m_max = std::max( histogram.m_max, m_max.load( std::memory_order_relaxed ) );
+}
+
+void atomic_histogram::reset() noexcept
+{
+    for( auto& bucket : m_buckets )
+    {
+        bucket.store( 0, std::memory_order_relaxed );
+    }
+
+    m_count.store( 0, std::memory_order_relaxed );
+    m_sum.store( 0, std::memory_order_relaxed );
+    m_max.store( 0, std::memory_order_relaxed );
+}
+
+worker_stats worker_counters::snapshot() const noexcept
+{
+    worker_stats result;
+
+    result.busy_time = std::chrono::nanoseconds{ busy_ns.load( std::memory_order_relaxed ) };
+    result.idle_time = std::chrono::nanoseconds{ idle_ns.load( std::memory_order_relaxed ) };
+    result.tasks = tasks.load( std::memory_order_relaxed );
+    result.steals = steals.load( std::memory_order_relaxed );
+    result.wakeups = wakeups.load( std::memory_order_relaxed );
+
+    return result;
+}
+
+void worker_counters::reset() noexcept
+{
+    for( auto& histogram : histograms )
+    {
+        histogram.reset();
+    }
+
+    busy_ns.store( 0, std::memory_order_relaxed );
+    idle_ns.store( 0, std::memory_order_relaxed );
+    tasks.store( 0, std::memory_order_relaxed );
+    steals.store( 0, std::memory_order_relaxed );
+    wakeups.store( 0, std::memory_order_relaxed );
+}
+
+}// details
+
+}// concurrency
+
+}// helpers
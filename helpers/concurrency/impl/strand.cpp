@@ -0,0 +1,126 @@
+#include "strand.h"
+
+#include <stdexcept>
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+constexpr size_t strand::default_batch_limit;
+
+thread_local const strand::state* strand::s_current_strand{ nullptr };
+
+strand::drainer::~drainer()
+{
+    if( !m_strand )
+    {
+        return;
+    }
+
+    // Tasks are destroyed after the lock is released, since their destructors may add new tasks
+    std::deque< unique_task > dropped;
+
+    {
+        std::lock_guard< std::mutex > l{ m_strand->mutex };
+
+        dropped.swap( m_strand->tasks );
+        m_strand->scheduled = false;
+    }
+}
+
+void strand::drainer::operator()()
+{
+    auto self = std::move( m_strand );
+    auto& batch = self->batch;
+
+    {
+        std::lock_guard< std::mutex > l{ self->mutex };
+
+        while( !self->tasks.empty() && batch.size() < self->batch_limit )
+        {
+            batch.emplace_back( std::move( self->tasks.front() ) );
+            self->tasks.pop_front();
+        }
+    }
+
+    const state* previous{ s_current_strand };
+    s_current_strand = self.get();
+
+    for( auto& task : batch )
+    {
+        // Like in the pool's workers, exceptions of the tasks without a future are ignored
+        try
+        {
+            task();
+        }
+        catch( ... )
+        {
+        }
+
+        task = nullptr;
+    }
+
+    s_current_strand = previous;
+    batch.clear();
+
+    bool more{ false };
+
+    {
+        std::lock_guard< std::mutex > l{ self->mutex };
+
+        more = !self->tasks.empty();
+        self->scheduled = more;
+    }
+
+    // Back to the end of the pool's queue, so that the other tasks get their turn
+    if( more )
+    {
+        // Bound first, before C++17 the argument may be moved from self before self->pool is read
+        thread_pool& pool = self->pool;
+        pool.post( drainer{ std::move( self ) } );
+    }
+}
+
+strand::strand( thread_pool& pool, size_t batch_limit ) :
+    m_state( std::make_shared< state >( pool, batch_limit ) )
+{
+    if( !batch_limit )
+    {
+        throw std::invalid_argument{ "Batch limit should be positive" };
+    }
+}
+
+bool strand::running_in_this_thread() const noexcept
+{
+    return s_current_strand == m_state.get();
+}
+
+size_t strand::size() const
+{
+    std::lock_guard< std::mutex > l{ m_state->mutex };
+    return m_state->tasks.size();
+}
+
+void strand::add( unique_task&& task )
+{
+    bool schedule{ false };
+
+    {
+        std::lock_guard< std::mutex > l{ m_state->mutex };
+
+        m_state->tasks.emplace_back( std::move( task ) );
+        schedule = !m_state->scheduled;
+        m_state->scheduled = true;
+    }
+
+    if( schedule )
+    {
+        m_state->pool.post( drainer{ m_state } );
+    }
+}
+
+}// concurrency
+
+}// helpers
@@ -0,0 +1,248 @@
+#include "task_graph.h"
+
+#include <stdexcept>
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+task_graph::node_run::~node_run()
+{
+    if( m_graph )
+    {
+        m_graph->drop( m_id );
+    }
+}
+
+void task_graph::node_run::operator()()
+{
+    task_graph* graph{ m_graph };
+    m_graph = nullptr;
+
+    graph->execute( m_id );
+}
+
+task_graph::node_id task_graph::add_node( unique_task&& task )
+{
+    if( m_running )
+    {
+        throw std::logic_error{ "Task graph can't be modified while running" };
+    }
+
+    m_nodes.emplace_back( std::move( task ) );
+
+    return m_nodes.size() - 1;
+}
+
+void task_graph::add_dependency( node_id before, node_id after )
+{
+    check_modifiable( before );
+    check_modifiable( after );
+
+    if( before == after )
+    {
+        throw std::invalid_argument{ "Node can't depend on itself" };
+    }
+
+    m_nodes[ before ].successors.emplace_back( after );
+    ++m_nodes[ after ].predecessors_number;
+    m_validated = false;
+}
+
+std::future< void > task_graph::run( thread_pool& pool )
+{
+    if( m_running )
+    {
+        throw std::logic_error{ "Task graph is already running" };
+    }
+
+    if( !m_validated )
+    {
+        check_acyclic();
+        m_validated = true;
+    }
+
+    m_promise = std::promise< void >{};
+    auto result = m_promise.get_future();
+
+    if( m_nodes.empty() )
+    {
+        m_promise.set_value();
+        return result;
+    }
+
+    m_pool = &pool;
+    m_error = nullptr;
+    m_failed = false;
+    m_remaining = m_nodes.size();
+
+    for( auto& n : m_nodes )
+    {
+        n.pending = n.predecessors_number;
+    }
+
+    m_running = true;
+
+    // Collect the roots first, a fast graph may finish while they're still being posted
+    std::vector< node_id > roots;
+    for( node_id id{ 0 }; id < m_nodes.size(); ++id )
+    {
+        if( !m_nodes[ id ].predecessors_number )
+        {
+            roots.emplace_back( id );
+        }
+    }
+
+    for( auto id : roots )
+    {
+        pool.post( node_run{ *this, id } );
+    }
+
+    return result;
+}
+
+void task_graph::check_modifiable( node_id id ) const
+{
+    if( m_running )
+    {
+        throw std::logic_error{ "Task graph can't be modified while running" };
+    }
+
+    if( id >= m_nodes.size() )
+    {
+        throw std::out_of_range{ "Invalid node id" };
+    }
+}
+
+void task_graph::check_acyclic() const
+{
+    // Kahn's algorithm, every node is reached only if there are no cycles
+    std::vector< size_t > pending( m_nodes.size() );
+    std::vector< node_id > ready;
+
+    for( node_id id{ 0 }; id < m_nodes.size(); ++id )
+    {
+        pending[ id ] = m_nodes[ id ].predecessors_number;
+
+        if( !pending[ id ] )
+        {
+            ready.emplace_back( id );
+        }
+    }
+
+    size_t reached{ 0 };
+
+    while( !ready.empty() )
+    {
+        const node_id id{ ready.back() };
+        ready.pop_back();
+        ++reached;
+
+        for( auto successor : m_nodes[ id ].successors )
+        {
+            if( !--pending[ successor ] )
+            {
+                ready.emplace_back( successor );
+            }
+        }
+    }
+
+    if( reached != m_nodes.size() )
+    {
+        throw std::logic_error{ "Task graph contains a cycle" };
+    }
+}
+
+void task_graph::execute( node_id id )
+{
+    bool has_next{ true };
+
+    while( has_next )
+    {
+        node& n = m_nodes[ id ];
+
+        if( !m_failed )
+        {
+            try
+            {
+                n.task();
+            }
+            catch( ... )
+            {
+                set_error( std::current_exception() );
+            }
+        }
+
+        // The last successor which became ready is executed right away instead of going through the queue
+        has_next = false;
+
+        for( auto successor : n.successors )
+        {
+            if( !--m_nodes[ successor ].pending )
+            {
+                if( has_next )
+                {
+                    m_pool->post( node_run{ *this, id } );
+                }
+
+                id = successor;
+                has_next = true;
+            }
+        }
+
+        // Nothing but locals may be touched after the last node is finished, the graph may be already destroyed
+        if( !--m_remaining )
+        {
+            finish();
+        }
+    }
+}
+
+void task_graph::drop( node_id id ) noexcept
+{
+    // The dropped node and the ones after it are skipped, so that the graph still finishes
+    try
+    {
+        set_error( std::make_exception_ptr( std::future_error{ std::future_errc::broken_promise } ) );
+        execute( id );
+    }
+    catch( ... )
+    {
+    }
+}
+
+void task_graph::set_error( std::exception_ptr error )
+{
+    std::lock_guard< std::mutex > l{ m_error_mutex };
+
+    if( !m_error )
+    {
+        m_error = std::move( error );
+    }
+
+    m_failed = true;
+}
+
+void task_graph::finish()
+{
+    // The graph may be run again or destroyed as soon as the future is ready, so the promise is moved out first
+    std::promise< void > promise{ std::move( m_promise ) };
+    std::exception_ptr error{ std::move( m_error ) };
+
+    m_running = false;
+
+    if( error )
+    {
+        promise.set_exception( error );
+    }
+    else
+    {
+        promise.set_value();
+    }
+}
+
+}// concurrency
+
+}// helpers
@@ -0,0 +1,126 @@
+#include "task_group.h"
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+bool task_group::state::run_one( std::unique_lock< std::mutex >& l )
+{
+    if( tasks.empty() )
+    {
+        return false;
+    }
+
+    unique_task task{ std::move( tasks.front() ) };
+    tasks.pop_front();
+
+    l.unlock();
+
+    // Like in the pool's workers, exceptions of the tasks without a future are ignored
+    try
+    {
+        task();
+    }
+    catch( ... )
+    {
+    }
+
+    task = nullptr;
+
+    l.lock();
+
+    if( !--unfinished && waiters )
+    {
+        waiters_cv.notify_all();
+    }
+
+    return true;
+}
+
+void task_group::puller::operator()()
+{
+    std::unique_lock< std::mutex > l{ group->mutex };
+    group->run_one( l );
+}
+
+task_group::task_group( thread_pool& pool ) :
+    m_pool( pool ),
+    m_state( std::make_shared< state >() )
+{
+}
+
+task_group::~task_group()
+{
+    wait();
+}
+
+void task_group::wait()
+{
+    std::unique_lock< std::mutex > l{ m_state->mutex };
+
+    while( m_state->unfinished )
+    {
+        if( !m_state->run_one( l ) )
+        {
+            ++m_state->waiters;
+            m_state->waiters_cv.wait( l );
+            --m_state->waiters;
+        }
+    }
+}
+
+size_t task_group::size() const
+{
+    std::lock_guard< std::mutex > l{ m_state->mutex };
+    return m_state->unfinished;
+}
+
+void task_group::add( unique_task&& task )
+{
+    {
+        std::lock_guard< std::mutex > l{ m_state->mutex };
+
+        m_state->tasks.emplace_back( std::move( task ) );
+        ++m_state->unfinished;
+
+        if( m_state->waiters )
+        {
+            m_state->waiters_cv.notify_one();
+        }
+    }
+
+    m_pool.post( puller{ m_state } );
+}
+
+bool task_group::wait_until( std::chrono::steady_clock::time_point deadline )
+{
+    std::unique_lock< std::mutex > l{ m_state->mutex };
+
+    while( m_state->unfinished )
+    {
+        if( std::chrono::steady_clock::now() >= deadline )
+        {
+            return false;
+        }
+
+        if( !m_state->run_one( l ) )
+        {
+            ++m_state->waiters;
+            const auto status = m_state->waiters_cv.wait_until( l, deadline );
+            --m_state->waiters;
+
+            if( status == std::cv_status::timeout )
+            {
+                return !m_state->unfinished;
+            }
+        }
+    }
+
+    return true;
+}
+
+}// concurrency
+
+}// helpers
@@ -7,52 +7,488 @@ namespace helpers
 namespace concurrency
 {
 
-thread_pool::thread_pool( size_t thread_number )
+namespace
 {
+
+// Indices of thread_pool::m_overflow_counters
+enum overflow_counter{ blocked_counter, timed_out_counter, rejected_counter, caller_runs_counter, dropped_counter };
+
+// Jump consistent hash by Lamping and Veach: when the number of buckets grows from n to n + 1,
+// only 1 / ( n + 1 ) of the keys move, all of them to the new bucket
+size_t jump_consistent_hash( uint64_t key, size_t buckets ) noexcept
+{
+    int64_t bucket{ -1 };
+    int64_t next{ 0 };
+
+    while( next < static_cast< int64_t >( buckets ) )
+    {
+        bucket = next;
+        key = key * 2862933555777941757ULL + 1;
+        next = static_cast< int64_t >( static_cast< double >( bucket + 1 ) * ( static_cast< double >( 1LL << 31 ) / static_cast< double >( ( key >> 33 ) + 1 ) ) );
+    }
+
+    return static_cast< size_t >( bucket );
+}
+
+}
+
+struct thread_pool::worker
+{
+    explicit worker( thread_pool* owner ) : owner( owner ){}
+
+    thread_pool* owner;
+    std::thread thread;
+    std::atomic_bool finished{ false };
+
+    // Set by schedule_remove_workers, the worker exits after its current task
+    std::atomic_bool retiring{ false };
+
+    // Victim search starting point, so that thieves don't all pick the same worker first
+    size_t next_victim{ 0 };
+
+    // Tasks taken from the lock-free queue since the last look into the mutex protected ones
+    size_t lock_free_streak{ 0 };
+
+    // NUMA node index and the CPUs the worker is pinned to, node is nodes_number() if the worker isn't placed
+    size_t node{ 0 };
+    std::vector< size_t > cpus;
+
+    std::mutex tasks_mutex;
+    std::deque< task_type > local_tasks;
+
+    // Tasks added with add_task_keyed, stamped to let the other workers steal them only after the delay.
+    // Once exiting is set, under tasks_mutex, keyed tasks go to the shared queue instead
+    struct keyed_task
+    {
+        task_type task;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    std::deque< keyed_task > keyed_tasks;
+    std::atomic< size_t > keyed_number{ 0 };
+    bool exiting{ false };
+
+    // Set while the worker sleeps on m_worker_cv, under m_tasks_mutex
+    std::atomic_bool parked{ false };
+
+    // Start of the current task, set only if timing is true
+    details::worker_counters stats;
+    bool timing{ false };
+    std::chrono::steady_clock::time_point task_start;
+};
+
+// Task added while the statistics are enabled, records its queue wait
+struct thread_pool::timed_task
+{
+    std::chrono::steady_clock::time_point enqueued;
+    task_type task;
+
+    void operator()()
+    {
+        worker* w = s_current_worker;
+
+        if( w && w->timing )
+        {
+            w->stats.record( pool_metric::queue_wait, w->task_start - enqueued );
+        }
+
+        task();
+    }
+};
+
+// Callable of a periodic timer, shared by its runs
+struct thread_pool::periodic_task
+{
+    explicit periodic_task( task_type&& task ) : task( std::move( task ) ){}
+
+    task_type task;
+    std::atomic_bool scheduled{ false };
+};
+
+// A run of a periodic task, lets the next one be scheduled once it's done or dropped
+struct thread_pool::periodic_run
+{
+    explicit periodic_run( std::shared_ptr< periodic_task > periodic ) noexcept : periodic( std::move( periodic ) ){}
+    periodic_run( periodic_run&& ) noexcept = default;
+
+    ~periodic_run()
+    {
+        if( periodic )
+        {
+            periodic->scheduled = false;
+        }
+    }
+
+    void operator()(){ periodic->task(); }
+
+    std::shared_ptr< periodic_task > periodic;
+};
+
+constexpr std::chrono::milliseconds thread_pool::timer_resolution;
+
+thread_local thread_pool::worker* thread_pool::s_current_worker{ nullptr };
+
+thread_pool::thread_pool( size_t thread_number, scheduling_policy policy, queue_backend backend, placement_policy placement ) :
+    m_policy( policy ),
+    m_lock_free_tasks( backend == queue_backend::lock_free ? new mpmc_queue< task_type >{ lock_free_queue_capacity } : nullptr ),
+    m_placement( placement ),
+    m_topology( cpu_topology::system() ),
+    m_node_tasks( m_topology.nodes_number() ),
+    m_node_pending( new std::atomic< size_t >[ m_topology.nodes_number() ] ),
+    m_node_workers( new std::atomic< size_t >[ m_topology.nodes_number() ] ),
+    m_node_parked( new size_t[ m_topology.nodes_number() ] ),
+    m_timer_epoch( std::chrono::steady_clock::now() )
+{
+    for( size_t node{ 0 }; node < m_topology.nodes_number(); ++node )
+    {
+        m_node_pending[ node ] = 0;
+        m_node_workers[ node ] = 0;
+        m_node_parked[ node ] = 0;
+    }
+
     add_workers( thread_number );
 }
 
 thread_pool::~thread_pool()
 {
+    // Pending timers are dropped while the pool is still running, since their destructors may add new tasks
+    {
+        timer_wheel< timer_task > dropped;
+
+        {
+            std::lock_guard< std::mutex > l{ m_timer_mutex };
+            m_timer_stop = true;
+            std::swap( dropped, m_timers );
+        }
+
+        m_timer_cv.notify_one();
+
+        if( m_timer_thread.joinable() )
+        {
+            m_timer_thread.join();
+        }
+    }
+
     m_is_running = false;
 
+    // Blocked submitters give up once the pool is stopped
+    {
+        std::lock_guard< std::mutex > l{ m_space_mutex };
+        m_space_cv.notify_all();
+    }
+
     clean_pending_tasks();
 
     // Wake all waiting threads
+    {
+        std::lock_guard< std::mutex > l{ m_tasks_mutex };
+    }
     m_worker_cv.notify_all();
 
-    for( auto& t : m_worker_pool )
+    for( auto& w : m_worker_pool )
     {
-        if( t.joinable() )
+        if( w->thread.joinable() )
         {
-            t.join();
+            w->thread.join();
         }
     }
 
+    // All workers are finished now, their statistics go to the totals like for the removed ones
+    {
+        std::lock_guard< std::mutex > l{ m_workers_mutex };
+        clean_removed_workers();
+    }
+
+    // Destructors of the dropped tasks may add new ones
+    while( m_queued_tasks )
+    {
+        clean_pending_tasks();
+    }
+
     m_tasks_status_cv.notify_all();
 }
 
+bool thread_pool::cancel_timer( timer_id id )
+{
+    std::lock_guard< std::mutex > l{ m_timer_mutex };
+    return m_timers.cancel( id );
+}
+
+size_t thread_pool::timers_number() const
+{
+    std::lock_guard< std::mutex > l{ m_timer_mutex };
+    return m_timers.size();
+}
+
 void thread_pool::clean_pending_tasks()
 {
-    std::lock_guard< std::mutex > l{ m_tasks_mutex };
+    // Tasks are destroyed only after all the locks are released, since their destructors may add new tasks
+    std::vector< task_type > dropped;
+
+    auto drop = [ &dropped ]( std::deque< task_type >& tasks )
+    {
+        std::move( tasks.begin(), tasks.end(), std::back_inserter( dropped ) );
+        tasks.clear();
+    };
+
+    {
+        std::lock_guard< std::mutex > l{ m_tasks_mutex };
+
+        for( size_t priority{ 0 }; priority < priorities_number; ++priority )
+        {
+            auto& pending = m_pending_tasks[ priority ];
+
+            if( !pending.empty() )
+            {
+                m_queued_tasks -= pending.size();
+                m_pending_number[ priority ] -= pending.size();
+                drop( pending );
+            }
+
+            m_passed_over[ priority ] = 0;
+        }
+
+        for( size_t node{ 0 }; node < m_node_tasks.size(); ++node )
+        {
+            auto& pending = m_node_tasks[ node ];
+
+            if( !pending.empty() )
+            {
+                m_queued_tasks -= pending.size();
+                m_node_pending[ node ] -= pending.size();
+
+                for( auto& node_task : pending )
+                {
+                    dropped.emplace_back( std::move( node_task.task ) );
+                }
+
+                pending.clear();
+            }
+        }
+    }
+
+    if( m_lock_free_tasks )
+    {
+        task_type task;
+
+        while( m_lock_free_tasks->try_pop( task ) )
+        {
+            --m_queued_tasks;
+            dropped.emplace_back( std::move( task ) );
+        }
+    }
+
+    {
+        rw_spinlock_guard g{ m_workers_lock, lock_mode::read };
+
+        for( auto& w : m_worker_pool )
+        {
+            std::lock_guard< std::mutex > l{ w->tasks_mutex };
+
+            if( !w->local_tasks.empty() )
+            {
+                m_queued_tasks -= w->local_tasks.size();
+                drop( w->local_tasks );
+            }
+
+            if( !w->keyed_tasks.empty() )
+            {
+                const size_t keyed{ w->keyed_tasks.size() };
+
+                for( auto& keyed_task : w->keyed_tasks )
+                {
+                    dropped.emplace_back( std::move( keyed_task.task ) );
+                }
+
+                w->keyed_tasks.clear();
+                w->keyed_number = 0;
+                m_queued_tasks -= keyed;
+                m_keyed_pending -= keyed;
+            }
+        }
+    }
+
+    // Counted as finished only after they're destroyed, so that the tasks added by the destructors are waited for too
+    const size_t count{ dropped.size() };
+    dropped.clear();
 
-    if( !m_pending_tasks.empty() )
+    if( count )
     {
-        m_tasks_number -= m_pending_tasks.size();
-        m_pending_tasks.clear();
+        notify_space( true );
+        finish_tasks( count );
+    }
+}
+
+void thread_pool::finish_tasks( size_t count )
+{
+    // Pairs with wait_until_finished: the waiter is registered before it checks the number of tasks
+    if( m_tasks_number.fetch_sub( count ) == count && m_status_waiters )
+    {
+        std::lock_guard< std::mutex > l{ m_status_mutex };
+        m_tasks_status_cv.notify_all();
     }
 }
 
 size_t thread_pool::total_tasks_number() const noexcept
 {
-    std::lock_guard< std::mutex > l{ m_tasks_mutex };
     return m_tasks_number;
 }
 
+void thread_pool::set_idle_policy( const idle_policy& policy ) noexcept
+{
+    m_spin_count = policy.spin_count;
+    m_yield_count = policy.yield_count;
+}
+
+idle_policy thread_pool::get_idle_policy() const noexcept
+{
+    idle_policy result;
+    result.spin_count = m_spin_count;
+    result.yield_count = m_yield_count;
+
+    return result;
+}
+
+void thread_pool::set_keyed_steal_delay( std::chrono::microseconds delay )
+{
+    m_keyed_steal_delay_us = static_cast< int64_t >( delay.count() );
+
+    // Workers waiting for the keyed tasks with the previous delay start over
+    std::lock_guard< std::mutex > l{ m_tasks_mutex };
+    m_worker_cv.notify_all();
+}
+
+std::chrono::microseconds thread_pool::keyed_steal_delay() const noexcept
+{
+    return std::chrono::microseconds{ m_keyed_steal_delay_us };
+}
+
+void thread_pool::set_node_steal_delay( std::chrono::microseconds delay )
+{
+    m_node_steal_delay_us = static_cast< int64_t >( delay.count() );
+
+    // Workers waiting for the other nodes' tasks with the previous delay start over
+    std::lock_guard< std::mutex > l{ m_tasks_mutex };
+    m_worker_cv.notify_all();
+}
+
+std::chrono::microseconds thread_pool::node_steal_delay() const noexcept
+{
+    return std::chrono::microseconds{ m_node_steal_delay_us };
+}
+
+void thread_pool::set_queue_limit( const queue_limit& limit )
+{
+    m_queue_capacity = limit.capacity;
+    m_overflow_policy = limit.policy;
+    m_block_timeout_ms = static_cast< int64_t >( limit.block_timeout.count() );
+
+    // The blocked submitters check the new capacity
+    std::lock_guard< std::mutex > l{ m_space_mutex };
+    m_space_cv.notify_all();
+}
+
+queue_limit thread_pool::get_queue_limit() const noexcept
+{
+    queue_limit result;
+    result.capacity = m_queue_capacity;
+    result.policy = m_overflow_policy;
+    result.block_timeout = std::chrono::milliseconds{ m_block_timeout_ms };
+
+    return result;
+}
+
+overflow_stats thread_pool::overflow_counters() const noexcept
+{
+    overflow_stats result;
+    result.blocked = m_overflow_counters[ blocked_counter ].load( std::memory_order_relaxed );
+    result.timed_out = m_overflow_counters[ timed_out_counter ].load( std::memory_order_relaxed );
+    result.rejected = m_overflow_counters[ rejected_counter ].load( std::memory_order_relaxed );
+    result.caller_runs = m_overflow_counters[ caller_runs_counter ].load( std::memory_order_relaxed );
+    result.dropped = m_overflow_counters[ dropped_counter ].load( std::memory_order_relaxed );
+
+    return result;
+}
+
+void thread_pool::enable_stats( bool enable ) noexcept
+{
+    m_stats_enabled = enable;
+}
+
+bool thread_pool::stats_enabled() const noexcept
+{
+    return m_stats_enabled;
+}
+
+pool_stats thread_pool::stats() const
+{
+    rw_spinlock_guard g{ m_workers_lock, lock_mode::read };
+
+    pool_stats result{ m_retired_stats };
+
+    for( const auto& w : m_worker_pool )
+    {
+        const worker_stats current{ w->stats.snapshot() };
+
+        result.m_workers.emplace_back( current );
+        result.m_total += current;
+
+        for( size_t metric{ 0 }; metric < result.m_histograms.size(); ++metric )
+        {
+            w->stats.histograms[ metric ].merge_to( result.m_histograms[ metric ] );
+        }
+    }
+
+    return result;
+}
+
+void thread_pool::reset_stats()
+{
+    rw_spinlock_guard g{ m_workers_lock, lock_mode::write };
+
+    m_retired_stats = pool_stats{};
+
+    for( auto& w : m_worker_pool )
+    {
+        w->stats.reset();
+    }
+}
+
+size_t thread_pool::completed_tasks_number() const noexcept
+{
+    return m_completed_tasks.load( std::memory_order_relaxed );
+}
+
 size_t thread_pool::queue_size() const noexcept
 {
-    std::lock_guard< std::mutex >{ m_tasks_mutex };
-    return m_pending_tasks.size();
+    return m_queued_tasks;
+}
+
+size_t thread_pool::queue_size( task_priority priority ) const noexcept
+{
+    const size_t index{ static_cast< size_t >( priority ) };
+
+    if( priority != task_priority::normal )
+    {
+        return m_pending_number[ index ];
+    }
+
+    // Tasks in workers' own queues are of normal priority
+    const size_t total{ m_queued_tasks };
+    const size_t other{ m_pending_number[ static_cast< size_t >( task_priority::high ) ] +
+                        m_pending_number[ static_cast< size_t >( task_priority::low ) ] };
+
+    return total > other ? total - other : 0;
+}
+
+void thread_pool::set_aging_limit( size_t limit ) noexcept
+{
+    m_aging_limit = limit;
+}
+
+size_t thread_pool::aging_limit() const noexcept
+{
+    return m_aging_limit;
 }
 
 void thread_pool::add_workers( uint32_t number )
@@ -67,8 +503,6 @@ void thread_pool::add_workers( uint32_t number )
         {
             add_worker();
         }
-
-        m_workers_number += number;
     }
 }
 
@@ -85,14 +519,26 @@ void thread_pool::schedule_remove_workers( uint32_t number )
             throw std::invalid_argument{ "Number of workers to remove is greater or equal to the avalable workers' number" };
         }
 
-        m_workers_number -= number;
-        m_workers_to_remove += number;
+        // The workers with the highest indices are retired, so that the keys of the rest keep their workers,
+        // see enqueue_keyed_task. The retiring ones stay after the active ones until they're removed
+        {
+            rw_spinlock_guard g{ m_workers_lock, lock_mode::write };
+
+            for( size_t index{ m_workers_number - number }; index < m_workers_number; ++index )
+            {
+                m_worker_pool[ index ]->retiring = true;
+            }
+
+            m_workers_number -= number;
+        }
 
-        // Wake possibly waiting threads to stop them
-        for( size_t thread{ 0 }; thread < number; ++thread )
         {
-            m_worker_cv.notify_one();
+            std::lock_guard< std::mutex > tl{ m_tasks_mutex };
+            m_workers_to_remove += number;
         }
+
+        // Wake possibly waiting threads to stop them
+        m_worker_cv.notify_all();
     }
 }
 
@@ -104,7 +550,6 @@ size_t thread_pool::workers_number() const noexcept
 
 size_t thread_pool::workers_to_remove() const noexcept
 {
-    std::lock_guard< std::mutex > l{ m_workers_mutex };
     return m_workers_to_remove;
 }
 
@@ -114,86 +559,1239 @@ thread_pool &thread_pool::get_instance()
     return p;
 }
 
-void thread_pool::add_worker()
+bool thread_pool::push_task( task_type&& task, task_priority priority )
+{
+    return push_tasks( &task, 1, priority ) == 1;
+}
+
+size_t thread_pool::push_tasks( task_type* tasks, size_t count, task_priority priority )
 {
-    std::thread t
+    return admit_tasks( tasks, count, [ this, priority ]( task_type* admitted, size_t number, bool reserved )
     {
-        [ this ]()
-        {
-            while( m_is_running )
-            {
-                std::function< void() > task;
+        enqueue_tasks( admitted, number, priority, reserved );
+    } );
+}
 
-                {
-                    std::unique_lock< std::mutex > l{ m_tasks_mutex };
-
-                    // Check before potentialy waiting for a task
-                    if( !m_is_running )
-                    {
-                        break;
-                    }
-
-                    {
-                        std::lock_guard< std::mutex > l{ m_workers_mutex };
-                        if( m_workers_to_remove )
-                        {
-                            --m_workers_to_remove;
-                            break;
-                        }
-                    }
-
-                    // If there's no pending tasks, wait for them/for a signal to be removed/for object destruction
-                    if( m_pending_tasks.empty() )
-                    {
-                        m_worker_cv.wait( l, [ this ](){
-                            std::lock_guard< std::mutex > wl{ m_workers_mutex };
-                            return !m_pending_tasks.empty() || m_workers_to_remove || !m_is_running; } );
-
-                        // Check after waiting
-                        if( !m_is_running )
-                        {
-                            break;
-                        }
-
-                        {
-                            std::lock_guard< std::mutex > l{ m_workers_mutex };
-                            if( m_workers_to_remove )
-                            {
-                                --m_workers_to_remove;
-                                break;
-                            }
-                        }
-                    }
-
-                    task = std::move( m_pending_tasks.front() );
-                    m_pending_tasks.pop_front();
-                }
+bool thread_pool::push_node_task( task_type&& task, size_t node )
+{
+    return admit_tasks( &task, 1, [ this, node ]( task_type* admitted, size_t, bool reserved )
+    {
+        enqueue_node_task( std::move( *admitted ), node, reserved );
+    } ) == 1;
+}
 
-                // Execute task
-                try
-                {
-                    task();
-                }
-                catch( const std::bad_function_call& ){}
+bool thread_pool::push_keyed_task( task_type&& task, size_t key_hash )
+{
+    return admit_tasks( &task, 1, [ this, key_hash ]( task_type* admitted, size_t, bool reserved )
+    {
+        enqueue_keyed_task( std::move( *admitted ), key_hash, reserved );
+    } ) == 1;
+}
 
-                // If there are no tasks left, notify threads waiting for the end of execution
-                std::lock_guard< std::mutex > l{ m_tasks_mutex };
-                if( !m_tasks_number )
-                {
-                    m_tasks_status_cv.notify_all();
-                }
-            }
+template< typename Enqueue >
+size_t thread_pool::admit_tasks( task_type* tasks, size_t count, Enqueue&& enqueue )
+{
+    if( !count )
+    {
+        return 0;
+    }
+
+    // The pool is being destroyed and nothing runs the tasks anymore, they're dropped right away like by
+    // clean_pending_tasks, instead of being queued. Their destructors may add new tasks, which are dropped the same way
+    if( !m_is_running )
+    {
+        for( size_t i{ 0 }; i < count; ++i )
+        {
+            tasks[ i ] = nullptr;
         }
-    };
 
-    m_worker_pool.push_back( std::move( t ) );
-}
+        return count;
+    }
+
+    if( !m_queue_capacity.load( std::memory_order_relaxed ) )
+    {
+        enqueue( tasks, count, false );
+        return count;
+    }
+
+    overflow_policy policy{ m_overflow_policy.load( std::memory_order_relaxed ) };
+    worker* current = s_current_worker;
+
+    if( policy == overflow_policy::block && current && current->owner == this )
+    {
+        policy = overflow_policy::caller_runs;
+    }
+
+    if( policy == overflow_policy::drop_oldest )
+    {
+        enqueue( tasks, count, false );
+        drop_overflow();
+
+        return count;
+    }
+
+    // Room is reserved in m_queued_tasks before the tasks are queued, so that concurrent submitters don't overfill the queue
+    size_t admitted{ reserve_tasks( count ) };
+
+    if( admitted )
+    {
+        enqueue( tasks, admitted, true );
+    }
+
+    if( admitted < count && policy == overflow_policy::block )
+    {
+        m_overflow_counters[ blocked_counter ].fetch_add( count - admitted, std::memory_order_relaxed );
+
+        const std::chrono::milliseconds timeout{ m_block_timeout_ms.load( std::memory_order_relaxed ) };
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+        // Registered before trying to reserve, so that the worker making room either sees the waiter or the waiter sees the room
+        std::unique_lock< std::mutex > l{ m_space_mutex };
+        ++m_space_waiters;
+
+        bool timed_out{ false };
+
+        while( admitted < count && m_is_running )
+        {
+            const size_t reserved{ reserve_tasks( count - admitted ) };
+
+            if( reserved )
+            {
+                l.unlock();
+                enqueue( tasks + admitted, reserved, true );
+                admitted += reserved;
+                l.lock();
+            }
+            else if( timed_out )
+            {
+                break;
+            }
+            else if( !timeout.count() )
+            {
+                m_space_cv.wait( l );
+            }
+            else
+            {
+                timed_out = m_space_cv.wait_until( l, deadline ) == std::cv_status::timeout;
+            }
+        }
+
+        --m_space_waiters;
+        l.unlock();
+
+        if( admitted < count && m_is_running )
+        {
+            m_overflow_counters[ timed_out_counter ].fetch_add( count - admitted, std::memory_order_relaxed );
+        }
+    }
+
+    if( admitted == count )
+    {
+        return count;
+    }
+
+    if( policy != overflow_policy::caller_runs )
+    {
+        m_overflow_counters[ rejected_counter ].fetch_add( count - admitted, std::memory_order_relaxed );
+        return admitted;
+    }
+
+    m_overflow_counters[ caller_runs_counter ].fetch_add( count - admitted, std::memory_order_relaxed );
+
+    // Like in the workers, exceptions of the posted tasks are ignored
+    for( size_t i{ admitted }; i < count; ++i )
+    {
+        try
+        {
+            tasks[ i ]();
+        }
+        catch( ... ){}
+
+        tasks[ i ] = nullptr;
+    }
+
+    return count;
+}
+
+size_t thread_pool::reserve_tasks( size_t count ) noexcept
+{
+    const size_t capacity{ m_queue_capacity.load( std::memory_order_relaxed ) };
+    size_t queued{ m_queued_tasks };
+    size_t reserved{ 0 };
+
+    do
+    {
+        if( capacity && queued >= capacity )
+        {
+            return 0;
+        }
+
+        reserved = capacity ? std::min( count, capacity - queued ) : count;
+    }
+    while( !m_queued_tasks.compare_exchange_weak( queued, queued + reserved ) );
+
+    return reserved;
+}
+
+void thread_pool::drop_overflow()
+{
+    // Tasks are destroyed after the lock is released, since their destructors may add new tasks
+    std::vector< task_type > dropped;
+
+    {
+        std::lock_guard< std::mutex > l{ m_tasks_mutex };
+
+        const size_t capacity{ m_queue_capacity };
+        size_t excess{ m_queued_tasks > capacity ? m_queued_tasks - capacity : 0 };
+
+        for( size_t priority{ priorities_number }; priority-- > 0 && excess; )
+        {
+            const bool normal{ priority == static_cast< size_t >( task_priority::normal ) };
+            task_type task;
+
+            // The lock-free ring holds the older normal priority tasks, the deque gets its overflow
+            while( normal && excess && m_lock_free_tasks && m_lock_free_tasks->try_pop( task ) )
+            {
+                dropped.emplace_back( std::move( task ) );
+                --m_queued_tasks;
+                --excess;
+            }
+
+            auto& pending = m_pending_tasks[ priority ];
+
+            while( excess && !pending.empty() )
+            {
+                dropped.emplace_back( std::move( pending.front() ) );
+                pending.pop_front();
+                --m_pending_number[ priority ];
+                --m_queued_tasks;
+                --excess;
+
+                m_passed_over[ priority ] = 0;
+            }
+        }
+
+        for( size_t node{ 0 }; node < m_node_tasks.size() && excess; ++node )
+        {
+            auto& pending = m_node_tasks[ node ];
+
+            while( excess && !pending.empty() )
+            {
+                dropped.emplace_back( std::move( pending.front().task ) );
+                pending.pop_front();
+                --m_node_pending[ node ];
+                --m_queued_tasks;
+                --excess;
+            }
+        }
+    }
+
+    const size_t count{ dropped.size() };
+
+    if( count )
+    {
+        m_overflow_counters[ dropped_counter ].fetch_add( count, std::memory_order_relaxed );
+
+        dropped.clear();
+        notify_space( true );
+        finish_tasks( count );
+    }
+}
+
+void thread_pool::notify_space( bool all )
+{
+    // Pairs with admit_tasks: the waiter is registered before it tries to reserve room
+    if( m_space_waiters )
+    {
+        std::lock_guard< std::mutex > l{ m_space_mutex };
+
+        if( all )
+        {
+            m_space_cv.notify_all();
+        }
+        else
+        {
+            m_space_cv.notify_one();
+        }
+    }
+}
+
+void thread_pool::enqueue_keyed_task( task_type&& task, size_t key_hash, bool reserved )
+{
+    if( m_finished_workers && m_is_running )
+    {
+        std::lock_guard< std::mutex > l{ m_workers_mutex };
+        clean_removed_workers();
+    }
+
+    if( m_stats_enabled.load( std::memory_order_relaxed ) )
+    {
+        stamp_tasks( &task, 1 );
+    }
+
+    bool queued{ false };
+    bool parked{ false };
+
+    {
+        rw_spinlock_guard g{ m_workers_lock, lock_mode::read };
+
+        if( m_workers_number )
+        {
+            // Only the active workers, which come first, are hashed over. Workers are added and retired at the end
+            // of them, so jump consistent hash moves only the keys of the added or retired workers
+            worker& target = *m_worker_pool[ jump_consistent_hash( key_hash, m_workers_number ) ];
+            std::lock_guard< std::mutex > l{ target.tasks_mutex };
+
+            if( !target.exiting )
+            {
+                ++m_tasks_number;
+
+                target.keyed_tasks.emplace_back( worker::keyed_task{ std::move( task ), std::chrono::steady_clock::now() } );
+
+                // The pending keyed counter goes first, so that the workers never see more unkeyed tasks than there are
+                ++target.keyed_number;
+                ++m_keyed_pending;
+
+                if( !reserved )
+                {
+                    ++m_queued_tasks;
+                }
+
+                queued = true;
+                parked = target.parked;
+            }
+        }
+    }
+
+    // The worker is leaving the pool, the task goes to the shared queue
+    if( !queued )
+    {
+        enqueue_tasks( &task, 1, task_priority::normal, reserved );
+        return;
+    }
+
+    // The target has to be woken, there's no waking a particular worker, so all of them are.
+    // Otherwise a single idle worker is woken to start waiting for the steal delay
+    if( m_idle_workers )
+    {
+        {
+            std::lock_guard< std::mutex > l{ m_tasks_mutex };
+        }
+
+        if( parked )
+        {
+            m_worker_cv.notify_all();
+        }
+        else
+        {
+            m_worker_cv.notify_one();
+        }
+    }
+}
+
+void thread_pool::enqueue_node_task( task_type&& task, size_t node, bool reserved )
+{
+    if( m_finished_workers && m_is_running )
+    {
+        std::lock_guard< std::mutex > l{ m_workers_mutex };
+        clean_removed_workers();
+    }
+
+    if( m_stats_enabled.load( std::memory_order_relaxed ) )
+    {
+        stamp_tasks( &task, 1 );
+    }
+
+    ++m_tasks_number;
+
+    size_t parked{ 0 };
+
+    {
+        std::lock_guard< std::mutex > l{ m_tasks_mutex };
+
+        m_node_tasks[ node ].emplace_back( node_task{ std::move( task ), std::chrono::steady_clock::now() } );
+        ++m_node_pending[ node ];
+
+        if( !reserved )
+        {
+            ++m_queued_tasks;
+        }
+
+        parked = m_node_parked[ node ];
+    }
+
+    // Any worker takes the task of a node without workers
+    if( !m_node_workers[ node ] )
+    {
+        wake_workers( 1 );
+        return;
+    }
+
+    // The node's worker has to be woken, there's no waking a particular worker, so all of them are,
+    // the others go back to sleep. Otherwise a single idle worker is woken to start waiting for the steal delay
+    if( parked )
+    {
+        m_worker_cv.notify_all();
+    }
+    else if( m_idle_workers )
+    {
+        m_worker_cv.notify_one();
+    }
+}
+
+void thread_pool::enqueue_tasks( task_type* tasks, size_t count, task_priority priority, bool reserved )
+{
+    // Remove possibly stopped threads from pool, the destructor joins them itself
+    if( m_finished_workers && m_is_running )
+    {
+        std::lock_guard< std::mutex > l{ m_workers_mutex };
+        clean_removed_workers();
+    }
+
+    if( m_stats_enabled.load( std::memory_order_relaxed ) )
+    {
+        stamp_tasks( tasks, count );
+    }
+
+    m_tasks_number += count;
+
+    worker* current = s_current_worker;
+
+    if( m_policy == scheduling_policy::work_stealing && priority == task_priority::normal &&
+        current && current->owner == this )
+    {
+        {
+            std::lock_guard< std::mutex > l{ current->tasks_mutex };
+
+            for( size_t i{ 0 }; i < count; ++i )
+            {
+                current->local_tasks.emplace_back( std::move( tasks[ i ] ) );
+            }
+
+            if( !reserved )
+            {
+                m_queued_tasks += count;
+            }
+        }
+
+        // Sleeping workers check their predicate under m_tasks_mutex,
+        // so it has to be passed through before notification to not lose the wakeup
+        if( m_idle_workers )
+        {
+            {
+                std::lock_guard< std::mutex > l{ m_tasks_mutex };
+            }
+
+            wake_workers( count );
+        }
+    }
+    else if( m_lock_free_tasks && priority == task_priority::normal )
+    {
+        // Counted before being pushed, so that the counter never goes below the actual number of tasks
+        if( !reserved )
+        {
+            m_queued_tasks += count;
+        }
+
+        size_t pushed{ 0 };
+        while( pushed < count && m_lock_free_tasks->try_push( std::move( tasks[ pushed ] ) ) )
+        {
+            ++pushed;
+        }
+
+        if( pushed < count )
+        {
+            std::lock_guard< std::mutex > l{ m_tasks_mutex };
+
+            const size_t index{ static_cast< size_t >( task_priority::normal ) };
+
+            for( size_t i{ pushed }; i < count; ++i )
+            {
+                m_pending_tasks[ index ].emplace_back( std::move( tasks[ i ] ) );
+            }
+
+            m_pending_number[ index ] += count - pushed;
+        }
+
+        if( m_idle_workers )
+        {
+            {
+                std::lock_guard< std::mutex > l{ m_tasks_mutex };
+            }
+
+            wake_workers( count );
+        }
+    }
+    else
+    {
+        {
+            std::lock_guard< std::mutex > l{ m_tasks_mutex };
+
+            const size_t index{ static_cast< size_t >( priority ) };
+
+            for( size_t i{ 0 }; i < count; ++i )
+            {
+                m_pending_tasks[ index ].emplace_back( std::move( tasks[ i ] ) );
+            }
+
+            m_pending_number[ index ] += count;
+
+            if( !reserved )
+            {
+                m_queued_tasks += count;
+            }
+        }
+
+        wake_workers( count );
+    }
+}
+
+void thread_pool::stamp_tasks( task_type* tasks, size_t count )
+{
+    const auto now = std::chrono::steady_clock::now();
+
+    for( size_t i{ 0 }; i < count; ++i )
+    {
+        tasks[ i ] = task_type{ timed_task{ now, std::move( tasks[ i ] ) } };
+    }
+}
+
+bool thread_pool::pop_task( worker& w, task_type& task )
+{
+    if( !m_queued_tasks )
+    {
+        return false;
+    }
+
+    // High priority tasks go ahead of the worker's own ones
+    if( m_pending_number[ static_cast< size_t >( task_priority::high ) ] && pop_pending_task( task ) )
+    {
+        return true;
+    }
+
+    // Own queue, newest task is the most likely to have its data in cache
+    {
+        std::lock_guard< std::mutex > l{ w.tasks_mutex };
+
+        if( !w.local_tasks.empty() )
+        {
+            task = std::move( w.local_tasks.back() );
+            w.local_tasks.pop_back();
+            --m_queued_tasks;
+            return true;
+        }
+
+        // Keyed tasks in the order they were added
+        if( !w.keyed_tasks.empty() )
+        {
+            task = std::move( w.keyed_tasks.front().task );
+            w.keyed_tasks.pop_front();
+            --m_queued_tasks;
+            --w.keyed_number;
+            --m_keyed_pending;
+            return true;
+        }
+    }
+
+    // Own NUMA node's queue
+    if( w.node < m_node_tasks.size() && m_node_pending[ w.node ] && pop_node_task( w.node, task, false ) )
+    {
+        return true;
+    }
+
+    if( m_lock_free_tasks && pop_lock_free_task( w, task ) )
+    {
+        return true;
+    }
+
+    if( pop_pending_task( task ) )
+    {
+        return true;
+    }
+
+    if( m_policy == scheduling_policy::work_stealing && steal_task( w, task ) )
+    {
+        return true;
+    }
+
+    if( m_keyed_pending && steal_keyed_task( w, task ) )
+    {
+        return true;
+    }
+
+    // Other nodes' tasks as the last resort, once they've waited for their workers long enough
+    for( size_t node{ 0 }; node < m_node_tasks.size(); ++node )
+    {
+        if( node != w.node && m_node_pending[ node ] && pop_node_task( node, task, true ) )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool thread_pool::pop_node_task( size_t node, task_type& task, bool foreign )
+{
+    std::lock_guard< std::mutex > l{ m_tasks_mutex };
+
+    auto& pending = m_node_tasks[ node ];
+
+    if( pending.empty() )
+    {
+        return false;
+    }
+
+    // The oldest task goes first, if it hasn't waited long enough, neither have the rest
+    if( foreign && m_node_workers[ node ] &&
+        std::chrono::steady_clock::now() - pending.front().queued < std::chrono::microseconds{ m_node_steal_delay_us.load( std::memory_order_relaxed ) } )
+    {
+        return false;
+    }
+
+    task = std::move( pending.front().task );
+    pending.pop_front();
+    --m_node_pending[ node ];
+    --m_queued_tasks;
+
+    return true;
+}
+
+bool thread_pool::pop_pending_task( task_type& task )
+{
+    std::lock_guard< std::mutex > l{ m_tasks_mutex };
+
+    size_t selected{ priorities_number };
+
+    for( size_t priority{ 0 }; priority < priorities_number; ++priority )
+    {
+        if( !m_pending_tasks[ priority ].empty() )
+        {
+            selected = priority;
+            break;
+        }
+    }
+
+    if( selected == priorities_number )
+    {
+        return false;
+    }
+
+    // Aging, the lowest priority task that was passed over too many times goes first
+    if( m_aging_limit )
+    {
+        for( size_t priority{ priorities_number - 1 }; priority > selected; --priority )
+        {
+            if( !m_pending_tasks[ priority ].empty() && m_passed_over[ priority ] >= m_aging_limit )
+            {
+                selected = priority;
+                break;
+            }
+        }
+    }
+
+    for( size_t priority{ selected + 1 }; priority < priorities_number; ++priority )
+    {
+        if( !m_pending_tasks[ priority ].empty() )
+        {
+            ++m_passed_over[ priority ];
+        }
+    }
+
+    m_passed_over[ selected ] = 0;
+
+    auto& pending = m_pending_tasks[ selected ];
+    task = std::move( pending.front() );
+    pending.pop_front();
+    --m_pending_number[ selected ];
+    --m_queued_tasks;
+
+    return true;
+}
+
+bool thread_pool::pop_lock_free_task( worker& w, task_type& task )
+{
+    // Look into the mutex protected queues once in a while, so that the overflowed
+    // and the low priority tasks don't starve behind the lock-free queue
+    const size_t limit{ m_aging_limit };
+    const bool locked_waiting{ m_pending_number[ static_cast< size_t >( task_priority::normal ) ] ||
+                               ( limit && m_pending_number[ static_cast< size_t >( task_priority::low ) ] ) };
+
+    if( locked_waiting && ++w.lock_free_streak >= std::max< size_t >( limit, 1 ) )
+    {
+        w.lock_free_streak = 0;
+
+        if( pop_pending_task( task ) )
+        {
+            return true;
+        }
+    }
+
+    if( m_lock_free_tasks->try_pop( task ) )
+    {
+        --m_queued_tasks;
+        return true;
+    }
+
+    return false;
+}
+
+bool thread_pool::steal_task( worker& w, task_type& task )
+{
+    rw_spinlock_guard g{ m_workers_lock, lock_mode::read };
+
+    const size_t workers{ m_worker_pool.size() };
+
+    for( size_t i{ 0 }; i < workers; ++i )
+    {
+        worker& victim = *m_worker_pool[ ( w.next_victim + i ) % workers ];
+
+        if( &victim == &w )
+        {
+            continue;
+        }
+
+        // Skip busy victims instead of waiting for them, there may be other ones to steal from
+        std::unique_lock< std::mutex > l{ victim.tasks_mutex, std::try_to_lock };
+
+        if( l.owns_lock() && !victim.local_tasks.empty() )
+        {
+            task = std::move( victim.local_tasks.front() );
+            victim.local_tasks.pop_front();
+            --m_queued_tasks;
+
+            if( m_stats_enabled.load( std::memory_order_relaxed ) )
+            {
+                details::add_relaxed( w.stats.steals, 1 );
+            }
+
+            w.next_victim += i;
+            return true;
+        }
+    }
+
+    ++w.next_victim;
+    return false;
+}
+
+bool thread_pool::steal_keyed_task( worker& w, task_type& task )
+{
+    rw_spinlock_guard g{ m_workers_lock, lock_mode::read };
+
+    const auto stealable = std::chrono::steady_clock::now() - std::chrono::microseconds{ m_keyed_steal_delay_us.load( std::memory_order_relaxed ) };
+    const size_t workers{ m_worker_pool.size() };
+
+    for( size_t i{ 0 }; i < workers; ++i )
+    {
+        worker& victim = *m_worker_pool[ ( w.next_victim + i ) % workers ];
+
+        if( &victim == &w || !victim.keyed_number )
+        {
+            continue;
+        }
+
+        std::unique_lock< std::mutex > l{ victim.tasks_mutex, std::try_to_lock };
+
+        // The oldest task goes first, if it hasn't waited long enough, neither have the rest
+        if( l.owns_lock() && !victim.keyed_tasks.empty() && victim.keyed_tasks.front().queued <= stealable )
+        {
+            task = std::move( victim.keyed_tasks.front().task );
+            victim.keyed_tasks.pop_front();
+            --m_queued_tasks;
+            --victim.keyed_number;
+            --m_keyed_pending;
+
+            if( m_stats_enabled.load( std::memory_order_relaxed ) )
+            {
+                details::add_relaxed( w.stats.steals, 1 );
+            }
+
+            w.next_victim += i;
+            return true;
+        }
+    }
+
+    ++w.next_victim;
+    return false;
+}
+
+std::chrono::steady_clock::time_point thread_pool::keyed_steal_time( const worker& w )
+{
+    const std::chrono::microseconds delay{ m_keyed_steal_delay_us.load( std::memory_order_relaxed ) };
+    auto oldest = std::chrono::steady_clock::now();
+
+    rw_spinlock_guard g{ m_workers_lock, lock_mode::read };
+
+    for( auto& victim : m_worker_pool )
+    {
+        if( victim.get() == &w || !victim->keyed_number )
+        {
+            continue;
+        }
+
+        std::lock_guard< std::mutex > l{ victim->tasks_mutex };
+
+        if( !victim->keyed_tasks.empty() && victim->keyed_tasks.front().queued < oldest )
+        {
+            oldest = victim->keyed_tasks.front().queued;
+        }
+    }
+
+    return oldest + delay;
+}
+
+size_t thread_pool::claim_spinners( size_t count ) noexcept
+{
+    size_t spinning{ m_spinning_workers };
+
+    while( spinning && !m_spinning_workers.compare_exchange_weak( spinning, spinning - std::min( spinning, count ) ) ){}
+
+    return std::min( spinning, count );
+}
+
+size_t thread_pool::foreign_node_tasks( const worker& w, std::chrono::steady_clock::time_point& steal_time ) const
+{
+    const std::chrono::microseconds delay{ m_node_steal_delay_us.load( std::memory_order_relaxed ) };
+    size_t result{ 0 };
+
+    for( size_t node{ 0 }; node < m_node_tasks.size(); ++node )
+    {
+        const auto& pending = m_node_tasks[ node ];
+
+        if( node == w.node || !m_node_workers[ node ] || pending.empty() )
+        {
+            continue;
+        }
+
+        result += pending.size();
+        steal_time = std::min( steal_time, pending.front().queued + delay );
+    }
+
+    return result;
+}
+
+void thread_pool::wake_workers( size_t tasks_count )
+{
+    // Wake only as many sleeping workers as there are new tasks, not counting the spinning ones.
+    // Each task claims a spinning worker of its own, a spinner leaving without a task passes its claim on
+    if( !m_idle_workers )
+    {
+        return;
+    }
+
+    tasks_count -= claim_spinners( tasks_count );
+
+    const size_t idle{ m_idle_workers };
+
+    if( !tasks_count || !idle )
+    {
+        return;
+    }
+
+    if( tasks_count >= idle )
+    {
+        m_worker_cv.notify_all();
+    }
+    else
+    {
+        for( size_t i{ 0 }; i < tasks_count; ++i )
+        {
+            m_worker_cv.notify_one();
+        }
+    }
+}
+
+bool thread_pool::spin_for_task( worker& w, task_type& task )
+{
+    const size_t spins{ m_spin_count.load( std::memory_order_relaxed ) };
+    const size_t yields{ m_yield_count.load( std::memory_order_relaxed ) };
+
+    if( !spins && !yields )
+    {
+        return false;
+    }
+
+    // The worker can be claimed by a submitter while it's counted in m_spinning_workers
+    ++m_spinning_workers;
+    bool counted{ true };
+    bool claimed{ false };
+    bool found{ false };
+
+    for( size_t i{ 0 }; i < spins + yields && !found; ++i )
+    {
+        if( w.retiring || !m_is_running )
+        {
+            break;
+        }
+
+        if( m_queued_tasks.load( std::memory_order_relaxed ) )
+        {
+            // Not claimable while taking a task. If it's been claimed already, the task it takes covers the claim
+            if( counted )
+            {
+                counted = false;
+                claimed = !claim_spinners( 1 );
+            }
+
+            found = pop_task( w, task );
+
+            if( !found && !claimed )
+            {
+                ++m_spinning_workers;
+                counted = true;
+            }
+        }
+        else if( i < spins )
+        {
+            cpu_relax();
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    if( counted )
+    {
+        claimed = !claim_spinners( 1 );
+    }
+
+    // Claimed, but leaving without a task, a sleeping worker takes the claim over
+    if( claimed && !found && m_idle_workers )
+    {
+        {
+            std::lock_guard< std::mutex > l{ m_tasks_mutex };
+        }
+
+        m_worker_cv.notify_one();
+    }
+
+    return found;
+}
+
+timer_id thread_pool::add_timer( std::chrono::steady_clock::time_point time, task_type&& task, std::chrono::steady_clock::duration period )
+{
+    timer_task timer;
+
+    if( period.count() )
+    {
+        timer.periodic = std::make_shared< periodic_task >( std::move( task ) );
+    }
+    else
+    {
+        timer.task = std::move( task );
+    }
+
+    const uint64_t ticks{ static_cast< uint64_t >( ( period + timer_resolution - std::chrono::nanoseconds{ 1 } ) / timer_resolution ) };
+
+    std::lock_guard< std::mutex > l{ m_timer_mutex };
+
+    const timer_id id{ m_timers.add( timer_tick( time ), std::move( timer ), ticks ) };
+
+    if( !m_timer_thread.joinable() && !m_timer_stop )
+    {
+        m_timer_thread = std::thread{ &thread_pool::timer_loop, this };
+    }
+    else if( m_timers.next_event() < m_timer_wakeup )
+    {
+        m_timer_cv.notify_one();
+    }
+
+    return id;
+}
+
+uint64_t thread_pool::timer_tick( std::chrono::steady_clock::time_point time ) const noexcept
+{
+    // Rounded up, so that a timer never fires early
+    const auto since_epoch = time - m_timer_epoch;
+    return since_epoch.count() > 0 ? static_cast< uint64_t >( ( since_epoch + timer_resolution - std::chrono::nanoseconds{ 1 } ) / timer_resolution ) : 0;
+}
+
+void thread_pool::timer_loop()
+{
+    std::vector< task_type > expired;
+    std::unique_lock< std::mutex > l{ m_timer_mutex };
+
+    while( !m_timer_stop )
+    {
+        m_timers.advance( static_cast< uint64_t >( ( std::chrono::steady_clock::now() - m_timer_epoch ) / timer_resolution ),
+                          [ &expired ]( timer_task& timer )
+        {
+            if( !timer.periodic )
+            {
+                expired.emplace_back( std::move( timer.task ) );
+            }
+            else if( !timer.periodic->scheduled.exchange( true ) )
+            {
+                expired.emplace_back( periodic_run{ timer.periodic } );
+            }
+        } );
+
+        if( !expired.empty() )
+        {
+            l.unlock();
+            enqueue_tasks( expired.data(), expired.size(), task_priority::normal );
+            expired.clear();
+            l.lock();
+
+            continue;
+        }
+
+        m_timer_wakeup = m_timers.next_event();
+
+        if( m_timer_wakeup == timer_wheel< timer_task >::never )
+        {
+            m_timer_cv.wait( l );
+        }
+        else
+        {
+            m_timer_cv.wait_until( l, m_timer_epoch + m_timer_wakeup * timer_resolution );
+        }
+
+        m_timer_wakeup = timer_wheel< timer_task >::never;
+    }
+}
+
+void thread_pool::add_worker()
+{
+    std::unique_ptr< worker > w{ new worker{ this } };
+    worker& new_worker = *w;
+
+    place_worker( new_worker );
+
+    // Placed before the retiring workers, right after the active ones
+    {
+        rw_spinlock_guard g{ m_workers_lock, lock_mode::write };
+        m_worker_pool.insert( m_worker_pool.begin() + static_cast< std::ptrdiff_t >( m_workers_number ), std::move( w ) );
+        ++m_workers_number;
+    }
+
+    new_worker.thread = std::thread{ [ this, &new_worker ](){ worker_loop( new_worker ); } };
+}
+
+void thread_pool::place_worker( worker& w )
+{
+    w.node = m_topology.nodes_number();
+
+    if( m_placement == placement_policy::none )
+    {
+        return;
+    }
+
+    // Placement goes on from where the previous workers stopped, so that added workers follow the same policy
+    const size_t index{ m_placed_workers++ };
+    const auto& nodes = m_topology.nodes();
+
+    if( m_placement == placement_policy::nodes )
+    {
+        w.node = index % nodes.size();
+        w.cpus = nodes[ w.node ].cpus;
+    }
+    else
+    {
+        size_t cpu{ index % m_topology.cpus_number() };
+        size_t node{ 0 };
+
+        while( cpu >= nodes[ node ].cpus.size() )
+        {
+            cpu -= nodes[ node ].cpus.size();
+            ++node;
+        }
+
+        w.node = node;
+        w.cpus.assign( 1, nodes[ node ].cpus[ cpu ] );
+    }
+
+    // Until the worker exits, the node's tasks are left to it for the steal delay
+    ++m_node_workers[ w.node ];
+}
+
+void thread_pool::worker_loop( worker& w )
+{
+    s_current_worker = &w;
+
+    // Pinned from the worker itself, so that the memory it touches first is allocated on its node
+    if( !w.cpus.empty() )
+    {
+        set_current_thread_affinity( w.cpus );
+    }
+
+    task_type task;
+
+    while( m_is_running && !w.retiring )
+    {
+        if( pop_task( w, task ) || spin_for_task( w, task ) )
+        {
+            // A task was taken from the queue, which makes room for a blocked submitter
+            notify_space( false );
+
+            const bool timed{ m_stats_enabled.load( std::memory_order_relaxed ) };
+            w.timing = timed;
+            if( timed )
+            {
+                w.task_start = std::chrono::steady_clock::now();
+            }
+
+            // Execute task, exceptions of the posted tasks are ignored
+            try
+            {
+                task();
+            }
+            catch( ... ){}
+
+            if( timed )
+            {
+                const auto run_time = std::chrono::steady_clock::now() - w.task_start;
+
+                w.stats.record( pool_metric::run_time, run_time );
+                details::add_relaxed( w.stats.busy_ns, static_cast< uint64_t >( std::chrono::duration_cast< std::chrono::nanoseconds >( run_time ).count() ) );
+                details::add_relaxed( w.stats.tasks, 1 );
+            }
+
+            task = nullptr;
+            m_completed_tasks.fetch_add( 1, std::memory_order_relaxed );
+            finish_tasks( 1 );
+
+            continue;
+        }
+
+        // Keyed tasks of the other workers can be stolen once the oldest of them has waited for the steal delay.
+        // Found before taking m_tasks_mutex, which is never held while locking the workers' queues
+        auto steal_time = m_keyed_pending ? keyed_steal_time( w ) : std::chrono::steady_clock::time_point::max();
+
+        // If there's no pending tasks, wait for them/for a signal to be removed/for object destruction
+        std::unique_lock< std::mutex > l{ m_tasks_mutex };
+
+        const bool timed{ m_stats_enabled.load( std::memory_order_relaxed ) };
+        const auto idle_start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+        // The same goes for the tasks of the other nodes which have workers
+        const size_t foreign{ foreign_node_tasks( w, steal_time ) };
+        const bool placed{ w.node < m_node_tasks.size() };
+
+        ++m_idle_workers;
+        w.parked = true;
+
+        if( placed )
+        {
+            ++m_node_parked[ w.node ];
+        }
+
+        if( m_keyed_pending || foreign )
+        {
+            // The tasks of the others can't be taken yet, wait for them only until the oldest one can.
+            // Any notification ends the wait, so that the worker looks at the new tasks and the new delays
+            if( !( m_queued_tasks > m_keyed_pending + foreign || w.keyed_number || w.retiring || !m_is_running ) )
+            {
+                m_worker_cv.wait_until( l, steal_time );
+            }
+        }
+        else
+        {
+            m_worker_cv.wait( l, [ this, &w ](){ return m_queued_tasks || w.retiring || !m_is_running; } );
+        }
+
+        if( placed )
+        {
+            --m_node_parked[ w.node ];
+        }
+
+        w.parked = false;
+        --m_idle_workers;
+
+        if( timed )
+        {
+            const auto idle_time = std::chrono::steady_clock::now() - idle_start;
+
+            details::add_relaxed( w.stats.idle_ns, static_cast< uint64_t >( std::chrono::duration_cast< std::chrono::nanoseconds >( idle_time ).count() ) );
+            details::add_relaxed( w.stats.wakeups, 1 );
+        }
+    }
+
+    // Hand the worker's own tasks over to the rest of the pool
+    {
+        std::lock_guard< std::mutex > l{ w.tasks_mutex };
+
+        w.exiting = true;
+
+        for( auto& keyed_task : w.keyed_tasks )
+        {
+            w.local_tasks.emplace_back( std::move( keyed_task.task ) );
+        }
+
+        const size_t keyed{ w.keyed_tasks.size() };
+        w.keyed_tasks.clear();
+
+        if( !w.local_tasks.empty() )
+        {
+            std::lock_guard< std::mutex > tl{ m_tasks_mutex };
+
+            const size_t index{ static_cast< size_t >( task_priority::normal ) };
+
+            for( auto& t : w.local_tasks )
+            {
+                m_pending_tasks[ index ].emplace_back( std::move( t ) );
+            }
+
+            m_pending_number[ index ] += w.local_tasks.size();
+
+            w.keyed_number = 0;
+            m_keyed_pending -= keyed;
+
+            w.local_tasks.clear();
+            m_worker_cv.notify_all();
+        }
+    }
+
+    // The last worker of the node leaves its tasks to the others right away
+    if( w.node < m_node_tasks.size() && !--m_node_workers[ w.node ] && m_node_pending[ w.node ] )
+    {
+        std::lock_guard< std::mutex > l{ m_tasks_mutex };
+        m_worker_cv.notify_all();
+    }
+
+    s_current_worker = nullptr;
+
+    if( w.retiring )
+    {
+        --m_workers_to_remove;
+    }
+
+    w.finished = true;
+    ++m_finished_workers;
+}
 
 void thread_pool::clean_removed_workers()
 {
-    auto end = std::remove_if( m_worker_pool.begin(),
-                               m_worker_pool.end(),
-                               []( const std::thread& t ){ return !t.joinable(); } );
+    if( !m_finished_workers )
+    {
+        return;
+    }
+
+    rw_spinlock_guard g{ m_workers_lock, lock_mode::write };
+
+    auto end = std::stable_partition( m_worker_pool.begin(),
+                                      m_worker_pool.end(),
+                                      []( const std::unique_ptr< worker >& w ){ return !w->finished; } );
+
+    for( auto it = end; it != m_worker_pool.end(); ++it )
+    {
+        if( ( *it )->thread.joinable() )
+        {
+            ( *it )->thread.join();
+        }
+
+        --m_finished_workers;
+
+        // Keep the statistics of the removed workers in the totals
+        const auto& stats = ( *it )->stats;
+        m_retired_stats.m_total += stats.snapshot();
+
+        for( size_t metric{ 0 }; metric < m_retired_stats.m_histograms.size(); ++metric )
+        {
+            stats.histograms[ metric ].merge_to( m_retired_stats.m_histograms[ metric ] );
+        }
+    }
 
     m_worker_pool.erase( end, m_worker_pool.end() );
 }
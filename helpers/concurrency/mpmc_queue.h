@@ -0,0 +1,204 @@
+#ifndef HELPERS_MPMC_QUEUE
+#define HELPERS_MPMC_QUEUE
+
+#include <new>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+#include "../class/non_copyable.h"
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+/// \class mpmc_queue
+/// Lock-free bounded multi-producer/multi-consumer ring queue.
+/// Each slot carries a sequence number telling producers and consumers whose turn it is,
+/// so that they only contend on the head or the tail counter, kept on separate cache lines.
+/// Elements are constructed and moved out after their slot is claimed, a throw there would leave
+/// the slot unpublished and stall the ring for good, so the element operations must not throw
+template< typename T >
+class mpmc_queue : helpers::classes::non_copyable_non_movable
+{
+    static_assert( std::is_nothrow_move_constructible< T >::value && std::is_nothrow_move_assignable< T >::value,
+                   "Element should be nothrow move constructible and assignable" );
+
+public:
+    static constexpr size_t cache_line_size{ 64 };
+
+    // Capacity is rounded up to the power of two
+    explicit mpmc_queue( size_t capacity );
+    ~mpmc_queue();
+
+    // Returns false if the queue is full. T has to be nothrow constructible from args
+    template< typename... Args >
+    bool try_emplace( Args&&... args );
+    bool try_push( T&& value ){ return try_emplace( std::move( value ) ); }
+    bool try_push( const T& value ){ return try_emplace( value ); }
+
+    // Returns false if the queue is empty
+    bool try_pop( T& value );
+
+    size_t capacity() const noexcept{ return m_mask + 1; }
+
+    // Number of elements, may be outdated by the time it's returned
+    size_t size_approx() const noexcept;
+
+private:
+    struct cell
+    {
+        std::atomic< size_t > sequence;
+        typename std::aligned_storage< sizeof( T ), alignof( T ) >::type storage;
+
+        T* value() noexcept{ return reinterpret_cast< T* >( &storage ); }
+    };
+
+    static size_t round_capacity( size_t capacity );
+
+private:
+    const size_t m_mask;
+    const std::unique_ptr< cell[] > m_cells;
+
+    char m_head_padding[ cache_line_size ];
+    std::atomic< size_t > m_head{ 0 };
+    char m_tail_padding[ cache_line_size - sizeof( std::atomic< size_t > ) ];
+    std::atomic< size_t > m_tail{ 0 };
+    char m_end_padding[ cache_line_size - sizeof( std::atomic< size_t > ) ];
+};
+
+///// implementation
+
+template< typename T >
+mpmc_queue< T >::mpmc_queue( size_t capacity ) :
+    m_mask( round_capacity( capacity ) - 1 ),
+    m_cells( new cell[ m_mask + 1 ] )
+{
+    for( size_t i{ 0 }; i <= m_mask; ++i )
+    {
+        m_cells[ i ].sequence.store( i, std::memory_order_relaxed );
+    }
+}
+
+template< typename T >
+mpmc_queue< T >::~mpmc_queue()
+{
+    for( size_t pos{ m_head }; pos != m_tail; ++pos )
+    {
+        m_cells[ pos & m_mask ].value()->~T();
+    }
+}
+
+template< typename T >
+template< typename... Args >
+bool mpmc_queue< T >::try_emplace( Args&&... args )
+{
+    static_assert( std::is_nothrow_constructible< T, Args&&... >::value, "Element should be nothrow constructible from the arguments" );
+
+    size_t pos{ m_tail.load( std::memory_order_relaxed ) };
+    cell* c{ nullptr };
+
+    while( true )
+    {
+        c = &m_cells[ pos & m_mask ];
+        const size_t sequence{ c->sequence.load( std::memory_order_acquire ) };
+        const intptr_t diff{ static_cast< intptr_t >( sequence ) - static_cast< intptr_t >( pos ) };
+
+        if( !diff )
+        {
+            // The slot is free, try to claim it
+            if( m_tail.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+            {
+                break;
+            }
+        }
+        else if( diff < 0 )
+        {
+            // The slot still holds the value from the previous lap
+            return false;
+        }
+        else
+        {
+            pos = m_tail.load( std::memory_order_relaxed );
+        }
+    }
+
+    new( &c->storage ) T( std::forward< Args >( args )... );
+    c->sequence.store( pos + 1, std::memory_order_release );
+
+    return true;
+}
+
+template< typename T >
+bool mpmc_queue< T >::try_pop( T& value )
+{
+    size_t pos{ m_head.load( std::memory_order_relaxed ) };
+    cell* c{ nullptr };
+
+    while( true )
+    {
+        c = &m_cells[ pos & m_mask ];
+        const size_t sequence{ c->sequence.load( std::memory_order_acquire ) };
+        const intptr_t diff{ static_cast< intptr_t >( sequence ) - static_cast< intptr_t >( pos + 1 ) };
+
+        if( !diff )
+        {
+            // The slot is filled, try to claim it
+            if( m_head.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+            {
+                break;
+            }
+        }
+        else if( diff < 0 )
+        {
+            // The slot wasn't filled yet
+            return false;
+        }
+        else
+        {
+            pos = m_head.load( std::memory_order_relaxed );
+        }
+    }
+
+    value = std::move( *c->value() );
+    c->value()->~T();
+    c->sequence.store( pos + m_mask + 1, std::memory_order_release );
+
+    return true;
+}
+
+template< typename T >
+size_t mpmc_queue< T >::size_approx() const noexcept
+{
+    const size_t head{ m_head.load( std::memory_order_relaxed ) };
+    const size_t tail{ m_tail.load( std::memory_order_relaxed ) };
+
+    return tail > head ? tail - head : 0;
+}
+
+template< typename T >
+size_t mpmc_queue< T >::round_capacity( size_t capacity )
+{
+    if( capacity < 2 )
+    {
+        throw std::invalid_argument{ "Capacity should be at least 2" };
+    }
+
+    size_t result{ 2 };
+    while( result < capacity )
+    {
+        result <<= 1;
+    }
+
+    return result;
+}
+
+}// concurrency
+
+}// helpers
+
+#endif
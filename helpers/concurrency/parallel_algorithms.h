@@ -0,0 +1,359 @@
+#ifndef HELPERS_PARALLEL_ALGORITHMS
+#define HELPERS_PARALLEL_ALGORITHMS
+
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <iterator>
+#include <exception>
+#include <type_traits>
+#include <condition_variable>
+
+#include "thread_pool.h"
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+// static_chunks  - the range is split into one equal chunk per participating thread
+// dynamic_chunks - threads take fixed size chunks one by one until the range is exhausted
+// guided_chunks  - same as dynamic, but the chunk size shrinks along with the remaining range
+enum class chunking_policy{ static_chunks, dynamic_chunks, guided_chunks };
+
+/// \brief Calls func( index ) for each index from [first, last).
+/// The range is split into chunks executed by the pool's workers and the calling thread.
+/// Blocks only to wait for the chunks already taken by the workers.
+/// The first exception thrown by func is rethrown after the rest of the range is skipped.
+/// grain is the chunk size for dynamic_chunks and the minimal chunk size for the others, 0 - automatic
+template< typename Index, typename Func,
+          typename std::enable_if< std::is_integral< Index >::value >::type* = nullptr >
+void parallel_for( thread_pool& pool, Index first, Index last, Func&& func,
+                   chunking_policy policy = chunking_policy::static_chunks, size_t grain = 0 );
+
+/// \brief Same as above, but calls func( *it ) for each iterator from [first, last)
+template< typename RandomIt, typename Func,
+          typename std::enable_if< !std::is_integral< RandomIt >::value >::type* = nullptr >
+void parallel_for( thread_pool& pool, RandomIt first, RandomIt last, Func&& func,
+                   chunking_policy policy = chunking_policy::static_chunks, size_t grain = 0 );
+
+/// \brief Returns reduce( ... reduce( init, map( first ) ) ..., map( last - 1 ) ).
+/// reduce should be associative and commutative, the order in which chunks' results are combined is unspecified
+template< typename Index, typename T, typename Map, typename Reduce,
+          typename std::enable_if< std::is_integral< Index >::value >::type* = nullptr >
+T parallel_reduce( thread_pool& pool, Index first, Index last, T init, Map&& map, Reduce&& reduce,
+                   chunking_policy policy = chunking_policy::static_chunks, size_t grain = 0 );
+
+/// \brief Same as above, reduces the elements of [first, last)
+template< typename RandomIt, typename T, typename Reduce,
+          typename std::enable_if< !std::is_integral< RandomIt >::value >::type* = nullptr >
+T parallel_reduce( thread_pool& pool, RandomIt first, RandomIt last, T init, Reduce&& reduce,
+                   chunking_policy policy = chunking_policy::static_chunks, size_t grain = 0 );
+
+/// \brief Assigns d_first[ i - first ] = func( i ) for each index from [first, last), returns the end of the output range
+template< typename Index, typename OutputIt, typename Func,
+          typename std::enable_if< std::is_integral< Index >::value >::type* = nullptr >
+OutputIt parallel_transform( thread_pool& pool, Index first, Index last, OutputIt d_first, Func&& func,
+                             chunking_policy policy = chunking_policy::static_chunks, size_t grain = 0 );
+
+/// \brief Assigns *( d_first + n ) = op( *( first + n ) ) for each element of [first, last), returns the end of the output range
+template< typename RandomIt, typename OutputIt, typename UnaryOp,
+          typename std::enable_if< !std::is_integral< RandomIt >::value >::type* = nullptr >
+OutputIt parallel_transform( thread_pool& pool, RandomIt first, RandomIt last, OutputIt d_first, UnaryOp&& op,
+                             chunking_policy policy = chunking_policy::static_chunks, size_t grain = 0 );
+
+namespace details
+{
+
+/// \class parallel_loop
+/// Shared state of one parallel algorithm call.
+/// Participants claim chunks of [0, count) until the range is exhausted,
+/// the caller waits for completion of all the claimed chunks
+template< typename Body >
+class parallel_loop
+{
+public:
+    parallel_loop( size_t count, size_t participants, chunking_policy policy, size_t grain, Body& body ) :
+        m_count( count ),
+        m_participants( participants ),
+        m_policy( policy ),
+        m_body( body )
+    {
+        switch( policy )
+        {
+        case chunking_policy::static_chunks:
+            m_chunk = std::max( grain, ( count + participants - 1 ) / participants );
+            break;
+        case chunking_policy::dynamic_chunks:
+            m_chunk = grain ? grain : std::max< size_t >( 1, count / ( participants * 8 ) );
+            break;
+        case chunking_policy::guided_chunks:
+            m_chunk = grain ? grain : 1;
+            break;
+        }
+    }
+
+    // Number of chunks, that may be executed in parallel
+    size_t max_chunks() const noexcept
+    {
+        return m_policy == chunking_policy::guided_chunks ? m_participants : ( m_count + m_chunk - 1 ) / m_chunk;
+    }
+
+    void run()
+    {
+        size_t begin{ 0 };
+        size_t end{ 0 };
+
+        while( claim( begin, end ) )
+        {
+            if( !m_failed )
+            {
+                try
+                {
+                    m_body( begin, end );
+                }
+                catch( ... )
+                {
+                    std::lock_guard< std::mutex > l{ m_mutex };
+
+                    if( !m_error )
+                    {
+                        m_error = std::current_exception();
+                        m_failed = true;
+                    }
+                }
+            }
+
+            if( m_done.fetch_add( end - begin ) + ( end - begin ) == m_count )
+            {
+                std::lock_guard< std::mutex > l{ m_mutex };
+                m_finished_cv.notify_all();
+            }
+        }
+    }
+
+    // Wait for the chunks being executed by other threads, rethrow the first exception
+    void wait()
+    {
+        std::unique_lock< std::mutex > l{ m_mutex };
+        m_finished_cv.wait( l, [ this ](){ return m_done == m_count; } );
+
+        if( m_error )
+        {
+            std::rethrow_exception( m_error );
+        }
+    }
+
+private:
+    bool claim( size_t& begin, size_t& end ) noexcept
+    {
+        size_t next{ m_next };
+
+        while( next < m_count )
+        {
+            size_t chunk{ m_chunk };
+            if( m_policy == chunking_policy::guided_chunks )
+            {
+                chunk = std::max( chunk, ( m_count - next ) / ( 2 * m_participants ) );
+            }
+
+            end = std::min( m_count, next + chunk );
+
+            if( m_next.compare_exchange_weak( next, end ) )
+            {
+                begin = next;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    const size_t m_count;
+    const size_t m_participants;
+    const chunking_policy m_policy;
+    size_t m_chunk{ 1 };
+    Body& m_body;
+
+    std::atomic< size_t > m_next{ 0 };
+    std::atomic< size_t > m_done{ 0 };
+    std::atomic_bool m_failed{ false };
+    std::exception_ptr m_error;
+
+    std::mutex m_mutex;
+    std::condition_variable m_finished_cv;
+};
+
+// Runs body( begin, end ) for the chunks of [0, count) on the pool and the calling thread
+template< typename Body >
+void parallel_chunks( thread_pool& pool, size_t count, chunking_policy policy, size_t grain, Body&& body )
+{
+    if( !count )
+    {
+        return;
+    }
+
+    using loop_type = parallel_loop< typename std::remove_reference< Body >::type >;
+
+    auto loop = std::make_shared< loop_type >( count, pool.workers_number() + 1, policy, grain, body );
+
+    // Helpers starting after the whole range was claimed return without touching the body. They're posted,
+    // the completion is tracked by the loop, so no futures are allocated for them
+    const size_t helpers{ std::min( pool.workers_number(), loop->max_chunks() - 1 ) };
+    for( size_t i{ 0 }; i < helpers; ++i )
+    {
+        pool.post( [ loop ](){ loop->run(); } );
+    }
+
+    loop->run();
+    loop->wait();
+}
+
+template< typename Index >
+size_t range_size( Index first, Index last ) noexcept
+{
+    return first < last ? static_cast< size_t >( last - first ) : 0;
+}
+
+}// details
+
+///// implementation
+
+template< typename Index, typename Func,
+          typename std::enable_if< std::is_integral< Index >::value >::type* >
+void parallel_for( thread_pool& pool, Index first, Index last, Func&& func, chunking_policy policy, size_t grain )
+{
+    details::parallel_chunks( pool, details::range_size( first, last ), policy, grain,
+                              [ first, &func ]( size_t begin, size_t end )
+                              {
+                                  for( size_t i{ begin }; i < end; ++i )
+                                  {
+                                      func( static_cast< Index >( first + static_cast< Index >( i ) ) );
+                                  }
+                              } );
+}
+
+template< typename RandomIt, typename Func,
+          typename std::enable_if< !std::is_integral< RandomIt >::value >::type* >
+void parallel_for( thread_pool& pool, RandomIt first, RandomIt last, Func&& func, chunking_policy policy, size_t grain )
+{
+    static_assert( std::is_base_of< std::random_access_iterator_tag,
+                                    typename std::iterator_traits< RandomIt >::iterator_category >::value,
+                   "Random access iterator required" );
+
+    details::parallel_chunks( pool, details::range_size( first, last ), policy, grain,
+                              [ first, &func ]( size_t begin, size_t end )
+                              {
+                                  auto it = first + begin;
+                                  for( size_t i{ begin }; i < end; ++i, ++it )
+                                  {
+                                      func( *it );
+                                  }
+                              } );
+}
+
+template< typename Index, typename T, typename Map, typename Reduce,
+          typename std::enable_if< std::is_integral< Index >::value >::type* >
+T parallel_reduce( thread_pool& pool, Index first, Index last, T init, Map&& map, Reduce&& reduce,
+                   chunking_policy policy, size_t grain )
+{
+    std::mutex result_mutex;
+
+    // Each chunk is reduced separately and merged into the result before being reported as done
+    details::parallel_chunks( pool, details::range_size( first, last ), policy, grain,
+                              [ & ]( size_t begin, size_t end )
+                              {
+                                  T partial( map( static_cast< Index >( first + static_cast< Index >( begin ) ) ) );
+                                  for( size_t i{ begin + 1 }; i < end; ++i )
+                                  {
+                                      partial = reduce( std::move( partial ), map( static_cast< Index >( first + static_cast< Index >( i ) ) ) );
+                                  }
+
+                                  std::lock_guard< std::mutex > l{ result_mutex };
+                                  init = reduce( std::move( init ), std::move( partial ) );
+                              } );
+
+    return init;
+}
+
+template< typename RandomIt, typename T, typename Reduce,
+          typename std::enable_if< !std::is_integral< RandomIt >::value >::type* >
+T parallel_reduce( thread_pool& pool, RandomIt first, RandomIt last, T init, Reduce&& reduce,
+                   chunking_policy policy, size_t grain )
+{
+    static_assert( std::is_base_of< std::random_access_iterator_tag,
+                                    typename std::iterator_traits< RandomIt >::iterator_category >::value,
+                   "Random access iterator required" );
+
+    std::mutex result_mutex;
+
+    details::parallel_chunks( pool, details::range_size( first, last ), policy, grain,
+                              [ & ]( size_t begin, size_t end )
+                              {
+                                  auto it = first + begin;
+                                  T partial( *it );
+                                  for( ++it; it != first + end; ++it )
+                                  {
+                                      partial = reduce( std::move( partial ), *it );
+                                  }
+
+                                  std::lock_guard< std::mutex > l{ result_mutex };
+                                  init = reduce( std::move( init ), std::move( partial ) );
+                              } );
+
+    return init;
+}
+
+template< typename Index, typename OutputIt, typename Func,
+          typename std::enable_if< std::is_integral< Index >::value >::type* >
+OutputIt parallel_transform( thread_pool& pool, Index first, Index last, OutputIt d_first, Func&& func,
+                             chunking_policy policy, size_t grain )
+{
+    const size_t count{ details::range_size( first, last ) };
+
+    details::parallel_chunks( pool, count, policy, grain,
+                              [ first, d_first, &func ]( size_t begin, size_t end )
+                              {
+                                  auto out = d_first + begin;
+                                  for( size_t i{ begin }; i < end; ++i, ++out )
+                                  {
+                                      *out = func( static_cast< Index >( first + static_cast< Index >( i ) ) );
+                                  }
+                              } );
+
+    return d_first + count;
+}
+
+template< typename RandomIt, typename OutputIt, typename UnaryOp,
+          typename std::enable_if< !std::is_integral< RandomIt >::value >::type* >
+OutputIt parallel_transform( thread_pool& pool, RandomIt first, RandomIt last, OutputIt d_first, UnaryOp&& op,
+                             chunking_policy policy, size_t grain )
+{
+    static_assert( std::is_base_of< std::random_access_iterator_tag,
+                                    typename std::iterator_traits< RandomIt >::iterator_category >::value,
+                   "Random access iterator required" );
+
+    const size_t count{ details::range_size( first, last ) };
+
+    details::parallel_chunks( pool, count, policy, grain,
+                              [ first, d_first, &op ]( size_t begin, size_t end )
+                              {
+                                  auto in = first + begin;
+                                  auto out = d_first + begin;
+                                  for( size_t i{ begin }; i < end; ++i, ++in, ++out )
+                                  {
+                                      *out = op( *in );
+                                  }
+                              } );
+
+    return d_first + count;
+}
+
+}// concurrency
+
+}// helpers
+
+#endif
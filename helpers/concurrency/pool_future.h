@@ -0,0 +1,632 @@
+#ifndef HELPERS_POOL_FUTURE
+#define HELPERS_POOL_FUTURE
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <vector>
+#include <iterator>
+#include <exception>
+#include <stdexcept>
+#include <functional>
+#include <type_traits>
+#include <condition_variable>
+
+#include "thread_pool.h"
+#include "unique_task.h"
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+template< typename T >
+class pool_future;
+
+namespace details
+{
+
+template< typename T >
+struct future_traits
+{
+    using value_type = T;
+    using reference = const T&;
+};
+
+template<>
+struct future_traits< void >
+{
+    using value_type = bool;
+    using reference = void;
+};
+
+template< typename T, typename Func >
+struct continuation_result
+{
+    using type = typename std::result_of< Func&( const T& ) >::type;
+};
+
+template< typename Func >
+struct continuation_result< void, Func >
+{
+    using type = typename std::result_of< Func&() >::type;
+};
+
+/// \class future_state
+/// Shared state of pool_future. Callbacks registered with on_ready()
+/// are executed in the thread which makes the state ready, their exceptions aren't propagated
+template< typename T >
+class future_state
+{
+public:
+    using value_type = typename future_traits< T >::value_type;
+    using reference = typename future_traits< T >::reference;
+
+    explicit future_state( thread_pool& pool ) : m_pool( pool ){}
+    ~future_state();
+
+    future_state( const future_state& ) = delete;
+    future_state& operator=( const future_state& ) = delete;
+
+    thread_pool& pool() const noexcept{ return m_pool; }
+
+    template< typename... Args >
+    void set_value( Args&&... args );
+    void set_exception( std::exception_ptr error );
+
+    // Execute the callback right away if the state is ready, otherwise once it becomes ready
+    void on_ready( unique_task&& callback );
+
+    bool is_ready() const;
+    void wait() const;
+
+    template< typename Rep, typename Period >
+    bool wait_for( const std::chrono::duration< Rep, Period >& timeout ) const;
+
+    // Block until ready, rethrow the stored exception
+    reference value() const;
+
+    // Stored exception, the state should be ready
+    std::exception_ptr error() const;
+
+private:
+    value_type* stored() const noexcept{ return reinterpret_cast< value_type* >( &m_storage ); }
+    void make_ready( std::unique_lock< std::mutex >& l );
+
+private:
+    thread_pool& m_pool;
+
+    mutable std::mutex m_mutex;
+    mutable std::condition_variable m_ready_cv;
+    bool m_ready{ false };
+    bool m_has_value{ false };
+    std::exception_ptr m_error;
+    mutable typename std::aligned_storage< sizeof( value_type ), alignof( value_type ) >::type m_storage;
+    std::vector< unique_task > m_callbacks;
+};
+
+template< typename Callable >
+void set_result( future_state< void >& state, Callable& callable )
+{
+    callable();
+    state.set_value( true );
+}
+
+template< typename Result, typename Callable >
+void set_result( future_state< Result >& state, Callable& callable )
+{
+    state.set_value( callable() );
+}
+
+template< typename Func >
+auto call_continuation( Func& func, const future_state< void >& previous ) -> typename std::result_of< Func&() >::type
+{
+    previous.value();
+    return func();
+}
+
+template< typename T, typename Func >
+auto call_continuation( Func& func, const future_state< T >& previous ) -> typename std::result_of< Func&( const T& ) >::type
+{
+    return func( previous.value() );
+}
+
+// Runs the callable in the pool, storing its result in the state
+template< typename Result, typename Callable >
+class async_job
+{
+public:
+    async_job( std::shared_ptr< future_state< Result > > state, Callable&& callable ) :
+        m_callable( std::move( callable ) ), m_state( std::move( state ) ){}
+
+    async_job( async_job&& ) = default;
+
+    // The job was dropped from the pool without being run
+    ~async_job()
+    {
+        if( m_state )
+        {
+            m_state->set_exception( std::make_exception_ptr( std::future_error{ std::future_errc::broken_promise } ) );
+        }
+    }
+
+    void operator()()
+    {
+        auto state = std::move( m_state );
+
+        try
+        {
+            set_result( *state, m_callable );
+        }
+        catch( ... )
+        {
+            state->set_exception( std::current_exception() );
+        }
+    }
+
+private:
+    // The callable is moved first, if its move throws, the source still holds the state and breaks it
+    Callable m_callable;
+    std::shared_ptr< future_state< Result > > m_state;
+};
+
+// Runs the function with the value of the previous future, an exception of the previous future is passed on
+template< typename T, typename Result, typename Func >
+class continuation
+{
+public:
+    continuation( std::shared_ptr< future_state< T > > previous, std::shared_ptr< future_state< Result > > next, Func&& func ) :
+        m_func( std::move( func ) ), m_previous( std::move( previous ) ), m_next( std::move( next ) ){}
+
+    continuation( continuation&& ) = default;
+
+    // The continuation was dropped from the pool without being run
+    ~continuation()
+    {
+        if( m_next )
+        {
+            m_next->set_exception( std::make_exception_ptr( std::future_error{ std::future_errc::broken_promise } ) );
+        }
+    }
+
+    void operator()()
+    {
+        auto next = std::move( m_next );
+
+        try
+        {
+            auto call = [ this ](){ return call_continuation( m_func, *m_previous ); };
+            set_result( *next, call );
+        }
+        catch( ... )
+        {
+            next->set_exception( std::current_exception() );
+        }
+    }
+
+private:
+    // The function is moved first, if its move throws, the source still holds the next state and breaks it
+    Func m_func;
+    std::shared_ptr< future_state< T > > m_previous;
+    std::shared_ptr< future_state< Result > > m_next;
+};
+
+// Callback which posts the task to the pool, so that a continuation never runs in the thread completing the future
+template< typename Task >
+class post_to_pool
+{
+public:
+    post_to_pool( thread_pool& pool, Task&& task ) : m_pool( &pool ), m_task( std::move( task ) ){}
+
+    void operator()(){ m_pool->post( std::move( m_task ) ); }
+
+private:
+    thread_pool* m_pool;
+    Task m_task;
+};
+
+}// details
+
+/// \class pool_future
+/// Future of a task executed in a thread_pool. Copies share the same state, like std::shared_future.
+/// Continuations attached with then() are posted to the same pool once the future is ready,
+/// so that chaining tasks doesn't block any thread
+template< typename T >
+class pool_future
+{
+public:
+    using value_type = T;
+    using reference = typename details::future_traits< T >::reference;
+
+    pool_future() noexcept = default;
+
+    bool valid() const noexcept{ return m_state != nullptr; }
+    bool is_ready() const;
+
+    void wait() const;
+
+    // Returns true if the future is ready
+    template< typename Rep, typename Period >
+    bool wait_for( const std::chrono::duration< Rep, Period >& timeout ) const;
+
+    // Block until ready, rethrow the stored exception
+    reference get() const;
+
+    // Run func with the value of this future in the pool once it's ready. If this future stores an exception,
+    // func is not called and the exception is passed on to the returned future
+    template< typename Func >
+    auto then( Func&& func ) const -> pool_future< typename details::continuation_result< T, typename std::decay< Func >::type >::type >;
+
+private:
+    template< typename >
+    friend class pool_future;
+
+    template< typename Func, typename... Args >
+    friend auto async_task( thread_pool& pool, Func&& func, Args&&... args )
+    -> pool_future< typename std::result_of< Func( Args... ) >::type >;
+
+    template< typename InputIt >
+    friend pool_future< void > when_all( InputIt first, InputIt last );
+
+    template< typename InputIt >
+    friend pool_future< size_t > when_any( InputIt first, InputIt last );
+
+    explicit pool_future( std::shared_ptr< details::future_state< T > > state ) : m_state( std::move( state ) ){}
+
+    void check_state() const;
+
+private:
+    std::shared_ptr< details::future_state< T > > m_state;
+};
+
+// Add func( args... ) to the pool, return its pool_future
+template< typename Func, typename... Args >
+auto async_task( thread_pool& pool, Func&& func, Args&&... args )
+-> pool_future< typename std::result_of< Func( Args... ) >::type >;
+
+// Future which becomes ready once all the futures from [first, last) are ready.
+// Stores the exception of the first failed one, if any
+template< typename InputIt >
+pool_future< void > when_all( InputIt first, InputIt last );
+
+// Future storing the index of the first ready future from [first, last)
+template< typename InputIt >
+pool_future< size_t > when_any( InputIt first, InputIt last );
+
+///// implementation
+
+namespace details
+{
+
+template< typename T >
+future_state< T >::~future_state()
+{
+    if( m_has_value )
+    {
+        stored()->~value_type();
+    }
+}
+
+template< typename T >
+template< typename... Args >
+void future_state< T >::set_value( Args&&... args )
+{
+    std::unique_lock< std::mutex > l{ m_mutex };
+
+    if( m_ready )
+    {
+        throw std::future_error{ std::future_errc::promise_already_satisfied };
+    }
+
+    new( &m_storage ) value_type( std::forward< Args >( args )... );
+    m_has_value = true;
+
+    make_ready( l );
+}
+
+template< typename T >
+void future_state< T >::set_exception( std::exception_ptr error )
+{
+    std::unique_lock< std::mutex > l{ m_mutex };
+
+    if( m_ready )
+    {
+        throw std::future_error{ std::future_errc::promise_already_satisfied };
+    }
+
+    m_error = std::move( error );
+
+    make_ready( l );
+}
+
+template< typename T >
+void future_state< T >::make_ready( std::unique_lock< std::mutex >& l )
+{
+    m_ready = true;
+
+    std::vector< unique_task > callbacks;
+    callbacks.swap( m_callbacks );
+
+    l.unlock();
+    m_ready_cv.notify_all();
+
+    // The state is ready, a failed callback mustn't reach the thread setting it. Destroying the callback breaks
+    // the promise of its continuation, the one the pool couldn't take
+    for( auto& callback : callbacks )
+    {
+        try
+        {
+            callback();
+        }
+        catch( ... )
+        {
+            callback = nullptr;
+        }
+    }
+}
+
+template< typename T >
+void future_state< T >::on_ready( unique_task&& callback )
+{
+    {
+        std::lock_guard< std::mutex > l{ m_mutex };
+
+        if( !m_ready )
+        {
+            m_callbacks.emplace_back( std::move( callback ) );
+            return;
+        }
+    }
+
+    callback();
+}
+
+template< typename T >
+bool future_state< T >::is_ready() const
+{
+    std::lock_guard< std::mutex > l{ m_mutex };
+    return m_ready;
+}
+
+template< typename T >
+void future_state< T >::wait() const
+{
+    std::unique_lock< std::mutex > l{ m_mutex };
+    m_ready_cv.wait( l, [ this ](){ return m_ready; } );
+}
+
+template< typename T >
+template< typename Rep, typename Period >
+bool future_state< T >::wait_for( const std::chrono::duration< Rep, Period >& timeout ) const
+{
+    std::unique_lock< std::mutex > l{ m_mutex };
+    return m_ready_cv.wait_for( l, timeout, [ this ](){ return m_ready; } );
+}
+
+template< typename T >
+typename future_state< T >::reference future_state< T >::value() const
+{
+    wait();
+
+    if( m_error )
+    {
+        std::rethrow_exception( m_error );
+    }
+
+    return static_cast< reference >( *stored() );
+}
+
+template< typename T >
+std::exception_ptr future_state< T >::error() const
+{
+    std::lock_guard< std::mutex > l{ m_mutex };
+    return m_error;
+}
+
+}// details
+
+template< typename T >
+bool pool_future< T >::is_ready() const
+{
+    check_state();
+    return m_state->is_ready();
+}
+
+template< typename T >
+void pool_future< T >::wait() const
+{
+    check_state();
+    m_state->wait();
+}
+
+template< typename T >
+template< typename Rep, typename Period >
+bool pool_future< T >::wait_for( const std::chrono::duration< Rep, Period >& timeout ) const
+{
+    check_state();
+    return m_state->wait_for( timeout );
+}
+
+template< typename T >
+typename pool_future< T >::reference pool_future< T >::get() const
+{
+    check_state();
+    return m_state->value();
+}
+
+template< typename T >
+template< typename Func >
+auto pool_future< T >::then( Func&& func ) const
+-> pool_future< typename details::continuation_result< T, typename std::decay< Func >::type >::type >
+{
+    using func_type = typename std::decay< Func >::type;
+    using result_type = typename details::continuation_result< T, func_type >::type;
+    using continuation_type = details::continuation< T, result_type, func_type >;
+
+    check_state();
+
+    auto next = std::make_shared< details::future_state< result_type > >( m_state->pool() );
+
+    m_state->on_ready( details::post_to_pool< continuation_type >{
+                           m_state->pool(), continuation_type{ m_state, next, func_type( std::forward< Func >( func ) ) } } );
+
+    return pool_future< result_type >{ std::move( next ) };
+}
+
+template< typename T >
+void pool_future< T >::check_state() const
+{
+    if( !m_state )
+    {
+        throw std::future_error{ std::future_errc::no_state };
+    }
+}
+
+template< typename Func, typename... Args >
+auto async_task( thread_pool& pool, Func&& func, Args&&... args )
+-> pool_future< typename std::result_of< Func( Args... ) >::type >
+{
+    using result_type = typename std::result_of< Func( Args... ) >::type;
+    using bound_type = decltype( std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) );
+
+    auto state = std::make_shared< details::future_state< result_type > >( pool );
+
+    pool.post( details::async_job< result_type, bound_type >{
+                   state, std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) } );
+
+    return pool_future< result_type >{ std::move( state ) };
+}
+
+template< typename InputIt >
+pool_future< void > when_all( InputIt first, InputIt last )
+{
+    using future_type = typename std::iterator_traits< InputIt >::value_type;
+    using state_type = details::future_state< typename future_type::value_type >;
+
+    struct counter
+    {
+        std::atomic< size_t > remaining;
+        std::shared_ptr< details::future_state< void > > result;
+        std::mutex error_mutex;
+        std::exception_ptr error;
+
+        void finish( std::exception_ptr future_error )
+        {
+            if( future_error )
+            {
+                std::lock_guard< std::mutex > l{ error_mutex };
+
+                if( !error )
+                {
+                    error = std::move( future_error );
+                }
+            }
+
+            if( !--remaining )
+            {
+                // All the other callbacks are finished, no lock needed
+                if( error )
+                {
+                    result->set_exception( error );
+                }
+                else
+                {
+                    result->set_value( true );
+                }
+            }
+        }
+    };
+
+    struct callback
+    {
+        std::shared_ptr< counter > c;
+        // The callback is owned by the state, so the state outlives it
+        const state_type* state;
+
+        void operator()(){ c->finish( state->error() ); }
+    };
+
+    std::vector< future_type > futures( first, last );
+
+    if( futures.empty() )
+    {
+        throw std::invalid_argument{ "No futures to wait for" };
+    }
+
+    for( const auto& future : futures )
+    {
+        future.check_state();
+    }
+
+    auto c = std::make_shared< counter >();
+    c->remaining = futures.size();
+    c->result = std::make_shared< details::future_state< void > >( futures.front().m_state->pool() );
+
+    pool_future< void > result{ c->result };
+
+    for( const auto& future : futures )
+    {
+        future.m_state->on_ready( callback{ c, future.m_state.get() } );
+    }
+
+    return result;
+}
+
+template< typename InputIt >
+pool_future< size_t > when_any( InputIt first, InputIt last )
+{
+    using future_type = typename std::iterator_traits< InputIt >::value_type;
+
+    struct winner
+    {
+        std::atomic_bool done{ false };
+        std::shared_ptr< details::future_state< size_t > > result;
+    };
+
+    struct callback
+    {
+        std::shared_ptr< winner > w;
+        size_t index;
+
+        void operator()()
+        {
+            if( !w->done.exchange( true ) )
+            {
+                w->result->set_value( index );
+            }
+        }
+    };
+
+    std::vector< future_type > futures( first, last );
+
+    if( futures.empty() )
+    {
+        throw std::invalid_argument{ "No futures to wait for" };
+    }
+
+    for( const auto& future : futures )
+    {
+        future.check_state();
+    }
+
+    auto w = std::make_shared< winner >();
+    w->result = std::make_shared< details::future_state< size_t > >( futures.front().m_state->pool() );
+
+    pool_future< size_t > result{ w->result };
+
+    for( size_t i{ 0 }; i < futures.size(); ++i )
+    {
+        futures[ i ].m_state->on_ready( callback{ w, i } );
+    }
+
+    return result;
+}
+
+}// concurrency
+
+}// helpers
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef HELPERS_POOL_SCALER
+#define HELPERS_POOL_SCALER
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstddef>
+#include <algorithm>
+#include <condition_variable>
+
+#include "thread_pool.h"
+#include "../class/non_copyable.h"
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+struct scaling_options
+{
+    size_t min_workers{ 1 };
+    size_t max_workers{ std::max( std::thread::hardware_concurrency(), 1u ) };
+
+    std::chrono::milliseconds sample_period{ 50 };
+
+    // The pool is overloaded when a newly queued task is expected to wait longer than max_wait
+    std::chrono::milliseconds max_wait{ 20 };
+
+    // The pool is underloaded when nothing is queued and the average share of busy workers is below min_utilization
+    double min_utilization{ 0.5 };
+
+    // Number of consecutive overloaded/underloaded samples needed to add/remove workers.
+    // The pool grows by doubling the workers and shrinks by one worker at a time
+    size_t grow_after{ 2 };
+    size_t shrink_after{ 100 };
+};
+
+/// \class pool_scaler
+/// Adds and removes workers of a thread_pool within [min_workers, max_workers].
+/// A background thread samples the queue size, the share of busy workers and
+/// the throughput of the pool, estimating task wait time with Little's law
+class pool_scaler : helpers::classes::non_copyable_non_movable
+{
+public:
+    // Brings the pool's workers number into the bounds right away.
+    // Throws std::invalid_argument if min_workers is 0, greater than max_workers or sample_period is 0
+    pool_scaler( thread_pool& pool, const scaling_options& options = scaling_options{} );
+    ~pool_scaler();
+
+    const scaling_options& options() const noexcept{ return m_options; }
+
+    // Number of times the pool was grown and shrunk
+    size_t grow_count() const noexcept{ return m_grow_count; }
+    size_t shrink_count() const noexcept{ return m_shrink_count; }
+
+private:
+    void sampling_loop();
+    void sample();
+
+private:
+    thread_pool& m_pool;
+    const scaling_options m_options;
+
+    // Accessed by the sampling thread only
+    std::chrono::steady_clock::time_point m_last_sample;
+    size_t m_last_completed{ 0 };
+    double m_utilization{ 0 };
+    size_t m_overloaded{ 0 };
+    size_t m_underloaded{ 0 };
+
+    std::atomic< size_t > m_grow_count{ 0 };
+    std::atomic< size_t > m_shrink_count{ 0 };
+
+    bool m_stop{ false };
+    std::mutex m_stop_mutex;
+    std::condition_variable m_stop_cv;
+    std::thread m_thread;
+};
+
+}// concurrency
+
+}// helpers
+
+#endif
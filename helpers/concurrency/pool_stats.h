@@ -0,0 +1,152 @@
+#ifndef HELPERS_POOL_STATS
+#define HELPERS_POOL_STATS
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+// queue_wait - time from adding a task to the start of its execution
+// run_time   - time of the task's execution
+enum class pool_metric{ queue_wait, run_time };
+
+namespace details
+{
+class atomic_histogram;
+}
+
+/// \class latency_histogram
+/// Histogram of durations with log2 buckets: bucket i holds durations
+/// of [2^i, 2^(i+1)) nanoseconds, bucket 0 holds 0 and 1 nanosecond
+class latency_histogram
+{
+public:
+    static constexpr size_t buckets_number{ 64 };
+    using duration = std::chrono::nanoseconds;
+
+    void add( duration d ) noexcept;
+    void merge( const latency_histogram& other ) noexcept;
+
+    uint64_t count() const noexcept{ return m_count; }
+    duration sum() const noexcept{ return duration{ m_sum }; }
+    duration max() const noexcept{ return duration{ m_max }; }
+
+    // Zero if empty
+    duration average() const noexcept;
+
+    // Upper bound of the bucket holding the quantile q of [0, 1], limited by max()
+    duration percentile( double q ) const noexcept;
+
+    const std::array< uint64_t, buckets_number >& buckets() const noexcept{ return m_buckets; }
+
+    static size_t bucket_of( duration d ) noexcept;
+
+private:
+    friend class details::atomic_histogram;
+
+    std::array< uint64_t, buckets_number > m_buckets{};
+    uint64_t m_count{ 0 };
+    uint64_t m_sum{ 0 };
+    uint64_t m_max{ 0 };
+};
+
+struct worker_stats
+{
+    std::chrono::nanoseconds busy_time{ 0 };
+    std::chrono::nanoseconds idle_time{ 0 };
+    uint64_t tasks{ 0 };
+    uint64_t steals{ 0 };
+    uint64_t wakeups{ 0 };
+
+    worker_stats& operator+=( const worker_stats& other ) noexcept;
+};
+
+/// \class pool_stats
+/// Snapshot of thread_pool statistics.
+/// Follows benchmarking::sample_storage interface for the latencies keyed by pool_metric
+class pool_stats
+{
+public:
+    using key_type = pool_metric;
+    using sample_type = std::chrono::nanoseconds;
+
+    // Throws std::out_of_range if there are no samples of the metric, like sample_storage
+    sample_type average_time( pool_metric metric ) const;
+    bool key_present( pool_metric metric ) const noexcept;
+
+    const latency_histogram& histogram( pool_metric metric ) const noexcept;
+
+    // Current workers, in the order they were added
+    const std::vector< worker_stats >& workers() const noexcept{ return m_workers; }
+
+    // All workers, including the removed ones
+    const worker_stats& total() const noexcept{ return m_total; }
+
+    // Share of the workers' time spent executing tasks
+    double utilization() const noexcept;
+
+private:
+    friend class thread_pool;
+
+    std::array< latency_histogram, 2 > m_histograms;
+    std::vector< worker_stats > m_workers;
+    worker_stats m_total;
+};
+
+namespace details
+{
+
+// Increment of a counter with a single writer, cheaper than fetch_add
+inline void add_relaxed( std::atomic< uint64_t >& counter, uint64_t value ) noexcept
+{
+    counter.store( counter.load( std::memory_order_relaxed ) + value, std::memory_order_relaxed );
+}
+
+/// \class atomic_histogram
+/// latency_histogram counterpart updated by a single writer with relaxed atomics,
+/// so that it can be read concurrently
+class atomic_histogram
+{
+public:
+    void add( std::chrono::nanoseconds d ) noexcept;
+    void merge_to( latency_histogram& histogram ) const noexcept;
+    void reset() noexcept;
+
+private:
+    std::array< std::atomic< uint64_t >, latency_histogram::buckets_number > m_buckets{};
+    std::atomic< uint64_t > m_count{ 0 };
+    std::atomic< uint64_t > m_sum{ 0 };
+    std::atomic< uint64_t > m_max{ 0 };
+};
+
+// Statistics of a single worker, written by the worker only
+struct worker_counters
+{
+    std::array< atomic_histogram, 2 > histograms;
+    std::atomic< uint64_t > busy_ns{ 0 };
+    std::atomic< uint64_t > idle_ns{ 0 };
+    std::atomic< uint64_t > tasks{ 0 };
+    std::atomic< uint64_t > steals{ 0 };
+    std::atomic< uint64_t > wakeups{ 0 };
+
+    void record( pool_metric metric, std::chrono::nanoseconds d ) noexcept{ histograms[ static_cast< size_t >( metric ) ].add( d ); }
+
+    worker_stats snapshot() const noexcept;
+    void reset() noexcept;
+};
+
+}// details
+
+}// concurrency
+
+}// helpers
+
+#endif
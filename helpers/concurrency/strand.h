@@ -0,0 +1,118 @@
+#ifndef HELPERS_STRAND
+#define HELPERS_STRAND
+
+#include <deque>
+#include <mutex>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "thread_pool.h"
+#include "unique_task.h"
+#include "../class/non_copyable.h"
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+/// \class strand
+/// Serial executor on top of a thread_pool: tasks of a strand run one at a time in the order
+/// they were added, while different strands run in parallel. No lock is held while a task runs.
+/// A single drainer per strand is posted to the pool at a time, it takes up to batch_limit
+/// pending tasks under one lock and runs them in a row on the same worker, then posts itself
+/// again if there's more, so that a busy strand doesn't hold a worker forever
+class strand : helpers::classes::non_copyable_non_movable
+{
+public:
+    static constexpr size_t default_batch_limit{ 64 };
+
+    // Throws std::invalid_argument if batch_limit is 0
+    explicit strand( thread_pool& pool, size_t batch_limit = default_batch_limit );
+
+    // Tasks already added are still executed after the strand is destroyed
+    ~strand() = default;
+
+    template< typename Func, typename... Args >
+    auto add_task( Func&& func, Args&&... args ) -> std::future< typename std::result_of< Func( Args... ) >::type >;
+
+    // Add a task without a future, exceptions thrown by the task are ignored
+    template< typename Func, typename... Args >
+    void post( Func&& func, Args&&... args );
+
+    // True if called from a task of this strand
+    bool running_in_this_thread() const noexcept;
+
+    // Number of pending tasks, not counting the ones taken by the drainer
+    size_t size() const;
+
+    thread_pool& pool() const noexcept{ return m_state->pool; }
+    size_t batch_limit() const noexcept{ return m_state->batch_limit; }
+
+private:
+    struct state
+    {
+        explicit state( thread_pool& pool, size_t batch_limit ) : pool( pool ), batch_limit( batch_limit ){}
+
+        thread_pool& pool;
+        const size_t batch_limit;
+
+        std::mutex mutex;
+        std::deque< unique_task > tasks;
+        bool scheduled{ false };
+
+        // Used by the drainer only, there's at most one at a time
+        std::vector< unique_task > batch;
+    };
+
+    // Runs a batch of the strand's tasks. If dropped by the pool without being run,
+    // drops the strand's pending tasks too, like thread_pool::clean_pending_tasks
+    class drainer
+    {
+    public:
+        explicit drainer( std::shared_ptr< state > strand ) noexcept : m_strand( std::move( strand ) ){}
+        drainer( drainer&& ) noexcept = default;
+        ~drainer();
+
+        void operator()();
+
+    private:
+        std::shared_ptr< state > m_strand;
+    };
+
+    void add( unique_task&& task );
+
+private:
+    const std::shared_ptr< state > m_state;
+
+    static thread_local const state* s_current_strand;
+};
+
+///// implementation
+
+template< typename Func, typename... Args >
+auto strand::add_task( Func&& func, Args&&... args ) -> std::future< typename std::result_of< Func( Args... ) >::type >
+{
+    using result_type = typename std::result_of< Func( Args... ) >::type;
+    using bound_type = decltype( std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) );
+
+    details::promised_task< result_type, bound_type > task{ std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) };
+    auto result = task.get_future();
+
+    add( std::move( task ) );
+
+    return result;
+}
+
+template< typename Func, typename... Args >
+void strand::post( Func&& func, Args&&... args )
+{
+    add( unique_task{ std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) } );
+}
+
+}// concurrency
+
+}// helpers
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef HELPERS_TASK_GRAPH
+#define HELPERS_TASK_GRAPH
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <vector>
+#include <exception>
+#include <initializer_list>
+
+#include "thread_pool.h"
+#include "unique_task.h"
+#include "../class/non_copyable.h"
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+/// \class task_graph
+/// Directed acyclic graph of tasks executed on a thread_pool.
+/// A node is posted to the pool once all of its predecessors are finished,
+/// so no worker ever blocks waiting for another node.
+/// The graph is reusable, each run() executes every node once
+class task_graph : helpers::classes::non_copyable_non_movable
+{
+public:
+    using node_id = size_t;
+
+    task_graph() = default;
+
+    // Add a node to be run after all of the predecessors are finished
+    template< typename Func >
+    node_id add_node( Func&& func, std::initializer_list< node_id > predecessors = {} );
+
+    // Make the node 'after' run only after the node 'before' is finished
+    void add_dependency( node_id before, node_id after );
+
+    // Post the nodes without predecessors to the pool, the future becomes ready once all the nodes are finished.
+    // If a node throws, the nodes which haven't started yet are skipped and the first exception is stored in the future.
+    // If the pool drops a posted node without running it, e.g. by clean_pending_tasks or a queue_limit, the graph
+    // fails the same way with std::future_error holding broken_promise.
+    // The graph should not be destroyed until the future is ready
+    std::future< void > run( thread_pool& pool );
+
+    bool is_running() const noexcept{ return m_running; }
+
+    size_t size() const noexcept{ return m_nodes.size(); }
+
+private:
+    struct node
+    {
+        explicit node( unique_task&& task ) : task( std::move( task ) ){}
+
+        unique_task task;
+        std::vector< node_id > successors;
+        size_t predecessors_number{ 0 };
+        std::atomic< size_t > pending{ 0 };
+    };
+
+    // Posted to the pool per node, fails the graph if it's dropped without being run
+    class node_run
+    {
+    public:
+        explicit node_run( task_graph& graph, node_id id ) noexcept : m_graph( &graph ), m_id( id ){}
+        node_run( node_run&& other ) noexcept : m_graph( other.m_graph ), m_id( other.m_id ){ other.m_graph = nullptr; }
+        ~node_run();
+
+        void operator()();
+
+    private:
+        task_graph* m_graph;
+        node_id m_id;
+    };
+
+    node_id add_node( unique_task&& task );
+    void check_modifiable( node_id id ) const;
+    void check_acyclic() const;
+    void execute( node_id id );
+    void drop( node_id id ) noexcept;
+    void set_error( std::exception_ptr error );
+    void finish();
+
+private:
+    // deque, so that the nodes are never moved
+    std::deque< node > m_nodes;
+    bool m_validated{ true };
+
+    thread_pool* m_pool{ nullptr };
+    std::atomic_bool m_running{ false };
+    std::atomic_bool m_failed{ false };
+    std::atomic< size_t > m_remaining{ 0 };
+
+    std::mutex m_error_mutex;
+    std::exception_ptr m_error;
+    std::promise< void > m_promise;
+};
+
+///// implementation
+
+template< typename Func >
+task_graph::node_id task_graph::add_node( Func&& func, std::initializer_list< node_id > predecessors )
+{
+    for( auto predecessor : predecessors )
+    {
+        check_modifiable( predecessor );
+    }
+
+    const node_id id{ add_node( unique_task{ std::forward< Func >( func ) } ) };
+
+    for( auto predecessor : predecessors )
+    {
+        add_dependency( predecessor, id );
+    }
+
+    return id;
+}
+
+}// concurrency
+
+}// helpers
+
+#endif
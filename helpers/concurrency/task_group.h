@@ -0,0 +1,119 @@
+#ifndef HELPERS_TASK_GROUP
+#define HELPERS_TASK_GROUP
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <condition_variable>
+
+#include "thread_pool.h"
+#include "unique_task.h"
+#include "../class/non_copyable.h"
+#include "../type_traits/type_traits.h"
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+/// \class task_group
+/// Tasks submitted to a thread_pool through the group, which can be waited for
+/// apart from the rest of the pool's tasks. The group keeps its own queue and posts
+/// a puller of a single task to the pool per task, so that a waiting thread takes
+/// the group's pending tasks and runs them itself instead of sleeping
+class task_group : helpers::classes::non_copyable_non_movable
+{
+public:
+    explicit task_group( thread_pool& pool );
+
+    // Waits for the group's tasks, running the pending ones
+    ~task_group();
+
+    template< typename Func, typename... Args >
+    auto add_task( Func&& func, Args&&... args ) -> std::future< typename std::result_of< Func( Args... ) >::type >;
+
+    // Add a task without a future, exceptions thrown by the task are ignored
+    template< typename Func, typename... Args >
+    void post( Func&& func, Args&&... args );
+
+    // Block until all the group's tasks are finished, running the pending ones in the calling thread
+    void wait();
+
+    // Same as above, on timeout returns false. Tasks are not interrupted, a task started
+    // before the timeout may finish after it
+    template< typename TimeoutType >
+    bool wait_for( const TimeoutType& timeout );
+
+    // Number of the group's tasks, both pending and being executed
+    size_t size() const;
+
+    thread_pool& pool() const noexcept{ return m_pool; }
+
+private:
+    struct state
+    {
+        // Waiters are woken when the group is finished or a new task is added
+        std::mutex mutex;
+        std::condition_variable waiters_cv;
+        std::deque< unique_task > tasks;
+        size_t unfinished{ 0 };
+        size_t waiters{ 0 };
+
+        // Run a pending task, returns false if there are none
+        bool run_one( std::unique_lock< std::mutex >& l );
+    };
+
+    // Posted to the pool for each task, runs one of the group's pending tasks, if any is left
+    struct puller
+    {
+        std::shared_ptr< state > group;
+
+        void operator()();
+    };
+
+    void add( unique_task&& task );
+    bool wait_until( std::chrono::steady_clock::time_point deadline );
+
+private:
+    thread_pool& m_pool;
+    const std::shared_ptr< state > m_state;
+};
+
+///// implementation
+
+template< typename Func, typename... Args >
+auto task_group::add_task( Func&& func, Args&&... args ) -> std::future< typename std::result_of< Func( Args... ) >::type >
+{
+    using result_type = typename std::result_of< Func( Args... ) >::type;
+    using bound_type = decltype( std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) );
+
+    details::promised_task< result_type, bound_type > task{ std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) };
+    auto result = task.get_future();
+
+    add( std::move( task ) );
+
+    return result;
+}
+
+template< typename Func, typename... Args >
+void task_group::post( Func&& func, Args&&... args )
+{
+    add( unique_task{ std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) } );
+}
+
+template< typename TimeoutType >
+bool task_group::wait_for( const TimeoutType& timeout )
+{
+    static_assert( type_traits::is_duration< TimeoutType >::value, "Timeout should be of type std::chrono" );
+
+    return wait_until( std::chrono::steady_clock::now() + std::chrono::duration_cast< std::chrono::steady_clock::duration >( timeout ) );
+}
+
+}// concurrency
+
+}// helpers
+
+#endif
@@ -1,41 +1,253 @@
 #ifndef HELPERS_THREAD_POOL
 #define HELPERS_THREAD_POOL
 
+#include <array>
 #include <deque>
+#include <memory>
+#include <vector>
 #include <atomic>
 #include <thread>
+#include <chrono>
+#include <iterator>
 #include <future>
 #include <random>
 #include <mutex>
+#include <stdexcept>
 #include <condition_variable>
 
+#include "unique_task.h"
+#include "mpmc_queue.h"
+#include "cpu_topology.h"
+#include "pool_stats.h"
+#include "cancellation.h"
+#include "timer_wheel.h"
+#include "atomic_locks.h"
 #include "../type_traits/type_traits.h"
 #include "../class/non_copyable.h"
 
+// Coroutine support is compiled only with C++20 coroutines available
+#if defined( __cpp_impl_coroutine ) && defined( __has_include )
+#if __has_include( <coroutine> )
+#include <coroutine>
+#define HELPERS_HAS_COROUTINES
+#endif
+#endif
+
 namespace helpers
 {
 
 namespace concurrency
 {
 
+// shared_queue  - all tasks go through one queue
+// work_stealing - tasks added from a worker go to its own queue,
+//                 idle workers steal tasks from the other workers' queues
+enum class scheduling_policy{ shared_queue, work_stealing };
+
+// locked    - shared queue is a mutex protected deque
+// lock_free - normal priority tasks go through a lock-free bounded ring,
+//             falling back to the mutex protected deque when it's full
+enum class queue_backend{ locked, lock_free };
+
+// none  - workers aren't pinned
+// cores - each worker is pinned to a single CPU, the CPUs are taken node by node
+// nodes - workers are spread round robin over NUMA nodes, each one is pinned to all CPUs of its node
+enum class placement_policy{ none, cores, nodes };
+
+// An idle worker spins spin_count times with cpu_relax(), then yields yield_count times and only then parks.
+// Spinning trades CPU time for a lower wakeup latency, by default workers park right away
+struct idle_policy
+{
+    size_t spin_count{ 0 };
+    size_t yield_count{ 0 };
+};
+
+// Tasks of a higher priority are executed first. To not let the lower priority tasks starve,
+// a task that was passed over aging_limit() times is executed regardless of its priority
+enum class task_priority{ high, normal, low };
+
+// What happens to a task added while the number of pending tasks is at the queue_limit capacity:
+// block       - the submitter waits for room, up to block_timeout if it isn't zero, then the task is rejected.
+//               The pool's own workers aren't blocked, since they may be the ones to make room, they run the task instead
+// reject      - the task isn't queued, add_task returns a future holding queue_full, post drops the task
+// caller_runs - the task is executed in the submitting thread
+// drop_oldest - the task is queued and the oldest pending tasks are dropped to make room, their futures get broken_promise.
+//               Tasks are dropped from the shared queues, lowest priority first, the ones in workers' own queues are kept
+enum class overflow_policy{ block, reject, caller_runs, drop_oldest };
+
+// Capacity of 0 means no limit. Tasks queued by the timers are never limited
+struct queue_limit
+{
+    size_t capacity{ 0 };
+    overflow_policy policy{ overflow_policy::block };
+    std::chrono::milliseconds block_timeout{ 0 };
+};
+
+// Number of tasks each overflow policy was applied to since the pool was created.
+// rejected counts all the rejected tasks, including the ones which timed out after blocking
+struct overflow_stats
+{
+    uint64_t blocked{ 0 };
+    uint64_t timed_out{ 0 };
+    uint64_t rejected{ 0 };
+    uint64_t caller_runs{ 0 };
+    uint64_t dropped{ 0 };
+};
+
+// Result of a task rejected by the queue_limit
+class queue_full : public std::runtime_error
+{
+public:
+    queue_full() : std::runtime_error{ "Task queue is full" }{}
+};
+
 class thread_pool : helpers::classes::non_copyable_non_movable
 {
 public:
-    explicit thread_pool( size_t workers_number = std::thread::hardware_concurrency() );
+    static constexpr size_t lock_free_queue_capacity{ 4096 };
+    static constexpr std::chrono::milliseconds timer_resolution{ 1 };
+
+    explicit thread_pool( size_t workers_number = std::thread::hardware_concurrency(),
+                          scheduling_policy policy = scheduling_policy::shared_queue,
+                          queue_backend backend = queue_backend::locked,
+                          placement_policy placement = placement_policy::none );
     ~thread_pool();
 
     template< typename Func, typename... Args >
     auto add_task( Func&& func, Args&&... args  ) -> std::future< typename std::result_of< Func( Args... ) >::type >;
 
+    // Same as above, with the specified priority. Tasks added without priority are of task_priority::normal
+    template< typename Func, typename... Args >
+    auto add_task( task_priority priority, Func&& func, Args&&... args  ) -> std::future< typename std::result_of< Func( Args... ) >::type >;
+
+    // Same as above, the task isn't started if the token is cancelled by then, its future gets task_cancelled instead.
+    // A running task may poll the token itself
+    template< typename Func, typename... Args >
+    auto add_task( cancellation_token token, Func&& func, Args&&... args  ) -> std::future< typename std::result_of< Func( Args... ) >::type >;
+
+    template< typename Func, typename... Args >
+    auto add_task( task_priority priority, cancellation_token token, Func&& func, Args&&... args  ) -> std::future< typename std::result_of< Func( Args... ) >::type >;
+
+    // Add a task to the queue of the NUMA node, an index in cpu_topology::system().nodes().
+    // The node's workers take it ahead of the shared queue, others only once it has waited for node_steal_delay(),
+    // or right away if no worker is placed on the node. Throws std::out_of_range if there's no such node
+    template< typename Func, typename... Args >
+    auto add_task_to_node( size_t node, Func&& func, Args&&... args  ) -> std::future< typename std::result_of< Func( Args... ) >::type >;
+
+    // Add a task to the own queue of the worker the key is hashed to, so that the tasks of a key run on the same worker.
+    // Other workers steal such a task only once it has waited for keyed_steal_delay(). The key needs std::hash,
+    // keys are spread over the workers with a consistent hash, adding workers moves only the keys the new ones get
+    template< typename Key, typename Func, typename... Args >
+    auto add_task_keyed( const Key& key, Func&& func, Args&&... args  ) -> std::future< typename std::result_of< Func( Args... ) >::type >;
+
+    // Add a task without a future, nothing is allocated for the result. Exceptions thrown by the task are ignored
+    template< typename Func, typename... Args >
+    void post( Func&& func, Args&&... args );
+
+    template< typename Func, typename... Args >
+    void post( task_priority priority, Func&& func, Args&&... args );
+
+    // Same as above, the task is silently skipped if the token is cancelled by the time it's started
+    template< typename Func, typename... Args >
+    void post( cancellation_token token, Func&& func, Args&&... args );
+
+    template< typename Func, typename... Args >
+    void post( task_priority priority, cancellation_token token, Func&& func, Args&&... args );
+
+    // Add all callables from [first, last) under a single queue lock, return their futures in the same order
+    template< typename InputIt >
+    auto add_tasks( InputIt first, InputIt last )
+    -> std::vector< std::future< typename std::result_of< typename std::decay< decltype( *first ) >::type&() >::type > >;
+
+    // Add func( index ) for each index from [first, last) under a single queue lock
+    template< typename Index, typename Func,
+              typename = typename std::enable_if< std::is_integral< Index >::value >::type >
+    auto add_tasks( Index first, Index last, Func&& func )
+    -> std::vector< std::future< typename std::result_of< Func&( Index ) >::type > >;
+
+    // Add a task to the queue after the delay or at the time point, with a precision of timer_resolution.
+    // Both std::chrono and temporal::details::time_ratio ( temporal::millisec_t etc ) are accepted,
+    // time_ratio time point is absolute, like the ones time_ratio::now() returns
+    template< typename Duration, typename Func, typename... Args >
+    auto add_task_after( const Duration& delay, Func&& func, Args&&... args ) -> std::future< typename std::result_of< Func( Args... ) >::type >;
+
+    template< typename TimePoint, typename Func, typename... Args >
+    auto add_task_at( const TimePoint& time, Func&& func, Args&&... args ) -> std::future< typename std::result_of< Func( Args... ) >::type >;
+
+    // Same as post, after the delay. The task can be cancelled with cancel_timer until it's queued
+    template< typename Duration, typename Func, typename... Args >
+    timer_id post_after( const Duration& delay, Func&& func, Args&&... args );
+
+    // Add the task to the queue every period until it's cancelled with cancel_timer.
+    // Runs never overlap, the ones falling due while the previous is still pending or running are skipped.
+    // Throws std::invalid_argument if the period is shorter than timer_resolution
+    template< typename Duration, typename Func, typename... Args >
+    timer_id add_periodic_task( const Duration& period, Func&& func, Args&&... args );
+
+    // Returns false if the timer has already fired or was cancelled
+    bool cancel_timer( timer_id id );
+
+#ifdef HELPERS_HAS_COROUTINES
+    class schedule_awaitable;
+
+    // co_await resumes the coroutine in one of the workers, right away or after the delay.
+    // If the pool drops the coroutine without resuming it, co_await throws std::future_error with broken_promise
+    schedule_awaitable schedule( task_priority priority = task_priority::normal ) noexcept;
+
+    template< typename Duration >
+    schedule_awaitable schedule_after( const Duration& delay ) noexcept;
+#endif
+
+    // Number of pending timers, including the periodic ones
+    size_t timers_number() const;
+
     // Remove all pending tasks, those being already executed are not affected
     void clean_pending_tasks();
 
     // Total number of tasks, both pending and being executed
     size_t total_tasks_number() const noexcept;
 
-    // Number of pending tasks
+    // Number of tasks finished since the pool was created
+    size_t completed_tasks_number() const noexcept;
+
+    // Number of pending tasks, including the ones in workers' own queues
     size_t queue_size() const noexcept;
 
+    // Number of pending tasks of the specified priority, tasks in workers' own queues are of normal priority
+    size_t queue_size( task_priority priority ) const noexcept;
+
+    // Number of times a pending task may be passed over by the higher priority ones, 0 - never run it ahead of them
+    void set_aging_limit( size_t limit ) noexcept;
+    size_t aging_limit() const noexcept;
+
+    void set_idle_policy( const idle_policy& policy ) noexcept;
+    idle_policy get_idle_policy() const noexcept;
+
+    // How long a keyed task waits for its worker before the idle ones may steal it, 1 millisecond by default
+    void set_keyed_steal_delay( std::chrono::microseconds delay );
+    std::chrono::microseconds keyed_steal_delay() const noexcept;
+
+    // How long a NUMA node's task waits for the node's workers before the other idle ones may take it, 1 millisecond by default
+    void set_node_steal_delay( std::chrono::microseconds delay );
+    std::chrono::microseconds node_steal_delay() const noexcept;
+
+    // Bound the number of pending tasks, the limit applies to the tasks added after the call
+    void set_queue_limit( const queue_limit& limit );
+    queue_limit get_queue_limit() const noexcept;
+
+    overflow_stats overflow_counters() const noexcept;
+
+    // Statistics are recorded only while enabled, otherwise the workers merely check the flag.
+    // Queue wait is measured for the tasks added while enabled, such tasks are wrapped and may need an allocation
+    void enable_stats( bool enable ) noexcept;
+    bool stats_enabled() const noexcept;
+
+    // Snapshot of the statistics recorded so far
+    pool_stats stats() const;
+
+    // Updates being recorded at the moment may survive the reset
+    void reset_stats();
+
     // Block until all tasks are finished. On timeout returns false
     template< typename TimeoutType = std::chrono::milliseconds >
     bool wait_until_finished( const TimeoutType& timeout = TimeoutType{ 0 } ) const;
@@ -43,7 +255,7 @@ public:
     // Add threads to the pool
     void add_workers( uint32_t number );
 
-    // Schedule threads to be removed from the pool.
+    // Schedule threads to be removed from the pool, the most recently added ones are removed.
     // Threads will be stopped only after finishing their current job
     // The actual stopped threads' objects will be removed after adding a new job
     void schedule_remove_workers( uint32_t number );
@@ -54,81 +266,503 @@ public:
     // Number of threads scheduled to be removed
     size_t workers_to_remove() const noexcept;
 
+    scheduling_policy policy() const noexcept{ return m_policy; }
+    placement_policy placement() const noexcept{ return m_placement; }
+    queue_backend backend() const noexcept{ return m_lock_free_tasks ? queue_backend::lock_free : queue_backend::locked; }
+
     // Static thread_pool created with default constructor
     static thread_pool& get_instance();
 
 private:
+    struct worker;
+    struct timed_task;
+    struct periodic_task;
+    struct periodic_run;
+    using task_type = unique_task;
+
+    static constexpr size_t priorities_number{ 3 };
+
+    // Stamped, so that the other nodes' workers take it only after the delay
+    struct node_task
+    {
+        task_type task;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    // Periodic timers share the task with its runs
+    struct timer_task
+    {
+        task_type task;
+        std::shared_ptr< periodic_task > periodic;
+    };
+
+    // Return false or the number of the admitted tasks, the rest are rejected by the queue_limit
+    bool push_task( task_type&& task, task_priority priority = task_priority::normal );
+    size_t push_tasks( task_type* tasks, size_t count, task_priority priority = task_priority::normal );
+    bool push_node_task( task_type&& task, size_t node );
+    bool push_keyed_task( task_type&& task, size_t key_hash );
+
+    // Put the tasks to the queues regardless of the limit, reserved - m_queued_tasks already counts them
+    void enqueue_tasks( task_type* tasks, size_t count, task_priority priority, bool reserved = false );
+    void enqueue_node_task( task_type&& task, size_t node, bool reserved );
+    void enqueue_keyed_task( task_type&& task, size_t key_hash, bool reserved );
+
+    template< typename Enqueue >
+    size_t admit_tasks( task_type* tasks, size_t count, Enqueue&& enqueue );
+    size_t reserve_tasks( size_t count ) noexcept;
+    void drop_overflow();
+    void notify_space( bool all );
+
+    template< typename Result >
+    static std::future< Result > rejected_future();
+    void stamp_tasks( task_type* tasks, size_t count );
+    bool pop_task( worker& w, task_type& task );
+    bool pop_pending_task( task_type& task );
+    bool pop_lock_free_task( worker& w, task_type& task );
+    bool steal_task( worker& w, task_type& task );
+    bool steal_keyed_task( worker& w, task_type& task );
+    std::chrono::steady_clock::time_point keyed_steal_time( const worker& w );
+    bool pop_node_task( size_t node, task_type& task, bool foreign );
+    size_t foreign_node_tasks( const worker& w, std::chrono::steady_clock::time_point& steal_time ) const;
+    size_t claim_spinners( size_t count ) noexcept;
+    void wake_workers( size_t tasks_count );
+    void finish_tasks( size_t count );
+    bool spin_for_task( worker& w, task_type& task );
+
+    timer_id add_timer( std::chrono::steady_clock::time_point time, task_type&& task,
+                        std::chrono::steady_clock::duration period = std::chrono::steady_clock::duration::zero() );
+    uint64_t timer_tick( std::chrono::steady_clock::time_point time ) const noexcept;
+    void timer_loop();
+
     void add_worker();
+    void place_worker( worker& w );
+    void worker_loop( worker& w );
     void clean_removed_workers();
 
 private:
+    const scheduling_policy m_policy;
+    const std::unique_ptr< mpmc_queue< task_type > > m_lock_free_tasks;
+    const placement_policy m_placement;
+    const cpu_topology& m_topology;
+    size_t m_placed_workers{ 0 };
+
     std::atomic_bool m_is_running{ true };
     size_t m_workers_number{ 0 };
-    size_t m_workers_to_remove{ 0 };
-
-    size_t m_tasks_number{ 0 };
-
-    std::vector< std::thread > m_worker_pool;
-    std::deque< std::function< void() > > m_pending_tasks;
+    std::atomic< size_t > m_workers_to_remove{ 0 };
+    std::atomic< size_t > m_finished_workers{ 0 };
+    std::atomic< size_t > m_idle_workers{ 0 };
+    // Spinning workers not claimed yet by the submitters, each one stands for a wakeup
+    std::atomic< size_t > m_spinning_workers{ 0 };
+    std::atomic< size_t > m_spin_count{ 0 };
+    std::atomic< size_t > m_yield_count{ 0 };
+
+    std::atomic< size_t > m_tasks_number{ 0 };
+    std::atomic< size_t > m_queued_tasks{ 0 };
+    std::atomic< size_t > m_completed_tasks{ 0 };
+
+    // Threads blocked in wait_until_finished, m_tasks_status_cv is signalled only if there are any
+    mutable std::atomic< size_t > m_status_waiters{ 0 };
+
+    // m_workers_lock guards the layout of m_worker_pool against stealing workers,
+    // m_workers_mutex serializes adding and removing of the workers
+    std::vector< std::unique_ptr< worker > > m_worker_pool;
+    mutable rw_spinlock m_workers_lock;
+
+    // Shared queues by priority, guarded by m_tasks_mutex.
+    // m_passed_over counts how many times the front task of the queue was passed over by the higher priority ones
+    std::array< std::deque< task_type >, priorities_number > m_pending_tasks;
+    std::array< std::atomic< size_t >, priorities_number > m_pending_number{};
+    std::array< size_t, priorities_number > m_passed_over{};
+    std::atomic< size_t > m_aging_limit{ 32 };
+
+    // Keyed tasks in the workers' own queues, they're counted in m_queued_tasks too
+    std::atomic< size_t > m_keyed_pending{ 0 };
+    std::atomic< int64_t > m_keyed_steal_delay_us{ 1000 };
+
+    // Submitters blocked by the queue_limit wait on m_space_cv, it's signalled only if there are any
+    std::atomic< size_t > m_queue_capacity{ 0 };
+    std::atomic< overflow_policy > m_overflow_policy{ overflow_policy::block };
+    std::atomic< int64_t > m_block_timeout_ms{ 0 };
+    std::atomic< size_t > m_space_waiters{ 0 };
+    std::array< std::atomic< uint64_t >, 5 > m_overflow_counters{};
+
+    // Statistics of the removed workers, guarded by m_workers_lock
+    std::atomic_bool m_stats_enabled{ false };
+    pool_stats m_retired_stats;
+
+    // Per NUMA node queues, guarded by m_tasks_mutex, as are the numbers of the node's parked workers
+    std::vector< std::deque< node_task > > m_node_tasks;
+    std::unique_ptr< std::atomic< size_t >[] > m_node_pending;
+    std::unique_ptr< std::atomic< size_t >[] > m_node_workers;
+    std::unique_ptr< size_t[] > m_node_parked;
+    std::atomic< int64_t > m_node_steal_delay_us{ 1000 };
+
+    // Timers are served by a thread started along with the first timer, it sleeps until
+    // m_timer_wakeup tick of the wheel. Lock order is m_timer_mutex, then m_tasks_mutex
+    const std::chrono::steady_clock::time_point m_timer_epoch;
+    timer_wheel< timer_task > m_timers;
+    uint64_t m_timer_wakeup{ timer_wheel< timer_task >::never };
+    bool m_timer_stop{ false };
+    std::thread m_timer_thread;
+    mutable std::mutex m_timer_mutex;
+    std::condition_variable m_timer_cv;
 
     mutable std::mutex m_tasks_mutex;
     mutable std::mutex m_workers_mutex;
+    mutable std::mutex m_status_mutex;
+    std::mutex m_space_mutex;
+    std::condition_variable m_space_cv;
     mutable std::condition_variable m_worker_cv;
     mutable std::condition_variable m_tasks_status_cv;
+
+    static thread_local worker* s_current_worker;
 };
 
+#ifdef HELPERS_HAS_COROUTINES
+class thread_pool::schedule_awaitable
+{
+public:
+    schedule_awaitable( thread_pool& pool, task_priority priority, std::chrono::steady_clock::duration delay ) noexcept :
+        m_pool( &pool ), m_priority( priority ), m_delay( delay ){}
+
+    bool await_ready() const noexcept{ return false; }
+
+    // Returns false, resuming the coroutine right away, if the resumer was run or dropped before the post returned,
+    // e.g. by overflow_policy::caller_runs or reject, so that the coroutine is never resumed inside await_suspend
+    bool await_suspend( std::coroutine_handle<> coroutine );
+    void await_resume() const;
+
+private:
+    // Resumes the coroutine when run. If dropped, resumes it to throw from co_await.
+    // Whichever of the resumer and await_suspend is the second to get there resumes the coroutine
+    class resumer
+    {
+    public:
+        resumer( std::coroutine_handle<> coroutine, schedule_awaitable& awaitable ) noexcept :
+            m_coroutine( coroutine ), m_awaitable( &awaitable ){}
+        resumer( resumer&& other ) noexcept :
+            m_coroutine( std::exchange( other.m_coroutine, nullptr ) ), m_awaitable( other.m_awaitable ){}
+
+        ~resumer()
+        {
+            if( m_coroutine )
+            {
+                m_awaitable->m_dropped = true;
+                resume();
+            }
+        }
+
+        void operator()(){ resume(); }
+
+    private:
+        void resume()
+        {
+            auto coroutine = std::exchange( m_coroutine, nullptr );
+
+            if( m_awaitable->m_handed_over.exchange( true, std::memory_order_acq_rel ) )
+            {
+                coroutine.resume();
+            }
+        }
+
+    private:
+        std::coroutine_handle<> m_coroutine;
+        schedule_awaitable* m_awaitable;
+    };
+
+private:
+    thread_pool* m_pool;
+    task_priority m_priority;
+    std::chrono::steady_clock::duration m_delay;
+    bool m_dropped{ false };
+    std::atomic_bool m_handed_over{ false };
+};
+#endif
+
 ///// implementation
 
 template< typename Func, typename... Args >
 auto thread_pool::add_task( Func&& func, Args&&... args  ) -> std::future< typename std::result_of< Func( Args... ) >::type >
 {
-    using Task = std::packaged_task< typename std::result_of<Func( Args... ) >::type() >;
-    auto task = std::make_shared< Task >( std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) );
-    auto result = task->get_future();
+    return add_task( task_priority::normal, std::forward< Func >( func ), std::forward< Args >( args )... );
+}
+
+template< typename Func, typename... Args >
+auto thread_pool::add_task( task_priority priority, Func&& func, Args&&... args  ) -> std::future< typename std::result_of< Func( Args... ) >::type >
+{
+    using result_type = typename std::result_of< Func( Args... ) >::type;
+    using bound_type = decltype( std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) );
+
+    // The promise lives inside the task itself, small tasks are stored in the queue without allocations
+    details::promised_task< result_type, bound_type > task{ std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) };
+    auto result = task.get_future();
+
+    if( !push_task( std::move( task ), priority ) )
+    {
+        return rejected_future< result_type >();
+    }
+
+    return result;
+}
+
+template< typename Func, typename... Args >
+auto thread_pool::add_task( cancellation_token token, Func&& func, Args&&... args  ) -> std::future< typename std::result_of< Func( Args... ) >::type >
+{
+    return add_task( task_priority::normal, std::move( token ), std::forward< Func >( func ), std::forward< Args >( args )... );
+}
+
+template< typename Func, typename... Args >
+auto thread_pool::add_task( task_priority priority, cancellation_token token, Func&& func, Args&&... args  ) -> std::future< typename std::result_of< Func( Args... ) >::type >
+{
+    using result_type = typename std::result_of< Func( Args... ) >::type;
+    using bound_type = decltype( std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) );
+    using cancellable_type = details::cancellable_task< bound_type, true >;
+
+    details::promised_task< result_type, cancellable_type > task{ cancellable_type{ std::move( token ), std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) } };
+    auto result = task.get_future();
+
+    if( !push_task( std::move( task ), priority ) )
+    {
+        return rejected_future< result_type >();
+    }
+
+    return result;
+}
+
+template< typename Func, typename... Args >
+auto thread_pool::add_task_to_node( size_t node, Func&& func, Args&&... args  ) -> std::future< typename std::result_of< Func( Args... ) >::type >
+{
+    using result_type = typename std::result_of< Func( Args... ) >::type;
+    using bound_type = decltype( std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) );
+
+    if( node >= m_node_tasks.size() )
+    {
+        throw std::out_of_range{ "Invalid NUMA node" };
+    }
+
+    details::promised_task< result_type, bound_type > task{ std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) };
+    auto result = task.get_future();
+
+    if( !push_node_task( std::move( task ), node ) )
+    {
+        return rejected_future< result_type >();
+    }
+
+    return result;
+}
+
+template< typename Key, typename Func, typename... Args >
+auto thread_pool::add_task_keyed( const Key& key, Func&& func, Args&&... args  ) -> std::future< typename std::result_of< Func( Args... ) >::type >
+{
+    using result_type = typename std::result_of< Func( Args... ) >::type;
+    using bound_type = decltype( std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) );
+
+    details::promised_task< result_type, bound_type > task{ std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) };
+    auto result = task.get_future();
+
+    if( !push_keyed_task( std::move( task ), std::hash< Key >{}( key ) ) )
+    {
+        return rejected_future< result_type >();
+    }
+
+    return result;
+}
+
+template< typename Func, typename... Args >
+void thread_pool::post( Func&& func, Args&&... args )
+{
+    post( task_priority::normal, std::forward< Func >( func ), std::forward< Args >( args )... );
+}
+
+template< typename Func, typename... Args >
+void thread_pool::post( task_priority priority, Func&& func, Args&&... args )
+{
+    push_task( task_type{ std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) }, priority );
+}
+
+template< typename Func, typename... Args >
+void thread_pool::post( cancellation_token token, Func&& func, Args&&... args )
+{
+    post( task_priority::normal, std::move( token ), std::forward< Func >( func ), std::forward< Args >( args )... );
+}
+
+template< typename Func, typename... Args >
+void thread_pool::post( task_priority priority, cancellation_token token, Func&& func, Args&&... args )
+{
+    using bound_type = decltype( std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) );
+
+    push_task( task_type{ details::cancellable_task< bound_type, false >{ std::move( token ), std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) } }, priority );
+}
+
+template< typename InputIt >
+auto thread_pool::add_tasks( InputIt first, InputIt last )
+-> std::vector< std::future< typename std::result_of< typename std::decay< decltype( *first ) >::type&() >::type > >
+{
+    using callable_type = typename std::decay< decltype( *first ) >::type;
+    using result_type = typename std::result_of< callable_type&() >::type;
 
+    std::vector< std::future< result_type > > results;
+    std::vector< task_type > tasks;
+
+    for( ; first != last; ++first )
     {
-        std::lock_guard< std::mutex > tl{ m_tasks_mutex };
+        details::promised_task< result_type, callable_type > task{ callable_type( *first ) };
+        results.emplace_back( task.get_future() );
+        tasks.emplace_back( std::move( task ) );
+    }
 
-        // Remove possibly stopped threads from pool
-        clean_removed_workers();
+    for( size_t i{ push_tasks( tasks.data(), tasks.size() ) }; i < results.size(); ++i )
+    {
+        results[ i ] = rejected_future< result_type >();
+    }
 
-        m_pending_tasks.emplace_back( [ task, this ]
-                                      {
-                                          if( task->valid() )
-                                            ( *task )();
+    return results;
+}
+
+template< typename Index, typename Func, typename >
+auto thread_pool::add_tasks( Index first, Index last, Func&& func )
+-> std::vector< std::future< typename std::result_of< Func&( Index ) >::type > >
+{
+    using result_type = typename std::result_of< Func&( Index ) >::type;
+    using bound_type = decltype( std::bind( func, first ) );
 
-                                           std::lock_guard< std::mutex > tl{ m_tasks_mutex };
-                                          --m_tasks_number;
-                                      } );
+    std::vector< std::future< result_type > > results;
+    std::vector< task_type > tasks;
 
-        ++m_tasks_number;
+    if( first < last )
+    {
+        results.reserve( static_cast< size_t >( last - first ) );
+        tasks.reserve( static_cast< size_t >( last - first ) );
+    }
+
+    for( ; first < last; ++first )
+    {
+        details::promised_task< result_type, bound_type > task{ std::bind( func, first ) };
+        results.emplace_back( task.get_future() );
+        tasks.emplace_back( std::move( task ) );
     }
 
-    m_worker_cv.notify_one();
+    for( size_t i{ push_tasks( tasks.data(), tasks.size() ) }; i < results.size(); ++i )
+    {
+        results[ i ] = rejected_future< result_type >();
+    }
+
+    return results;
+}
+
+template< typename Duration, typename Func, typename... Args >
+auto thread_pool::add_task_after( const Duration& delay, Func&& func, Args&&... args ) -> std::future< typename std::result_of< Func( Args... ) >::type >
+{
+    return add_task_at( std::chrono::steady_clock::now() + details::to_steady_duration( delay ),
+                        std::forward< Func >( func ), std::forward< Args >( args )... );
+}
+
+template< typename TimePoint, typename Func, typename... Args >
+auto thread_pool::add_task_at( const TimePoint& time, Func&& func, Args&&... args ) -> std::future< typename std::result_of< Func( Args... ) >::type >
+{
+    using result_type = typename std::result_of< Func( Args... ) >::type;
+    using bound_type = decltype( std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) );
+
+    details::promised_task< result_type, bound_type > task{ std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) };
+    auto result = task.get_future();
+
+    add_timer( details::to_steady_time( time ), std::move( task ) );
 
     return result;
 }
 
+template< typename Duration, typename Func, typename... Args >
+timer_id thread_pool::post_after( const Duration& delay, Func&& func, Args&&... args )
+{
+    return add_timer( std::chrono::steady_clock::now() + details::to_steady_duration( delay ),
+                      task_type{ std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) } );
+}
+
+template< typename Duration, typename Func, typename... Args >
+timer_id thread_pool::add_periodic_task( const Duration& period, Func&& func, Args&&... args )
+{
+    const auto interval = details::to_steady_duration( period );
+
+    if( interval < timer_resolution )
+    {
+        throw std::invalid_argument{ "Period should be at least timer_resolution" };
+    }
+
+    return add_timer( std::chrono::steady_clock::now() + interval,
+                      task_type{ std::bind( std::forward< Func >( func ), std::forward< Args >( args )... ) }, interval );
+}
+
+template< typename Result >
+std::future< Result > thread_pool::rejected_future()
+{
+    std::promise< Result > rejected;
+    rejected.set_exception( std::make_exception_ptr( queue_full{} ) );
+
+    return rejected.get_future();
+}
+
+#ifdef HELPERS_HAS_COROUTINES
+inline auto thread_pool::schedule( task_priority priority ) noexcept -> schedule_awaitable
+{
+    return schedule_awaitable{ *this, priority, std::chrono::steady_clock::duration::zero() };
+}
+
+template< typename Duration >
+auto thread_pool::schedule_after( const Duration& delay ) noexcept -> schedule_awaitable
+{
+    return schedule_awaitable{ *this, task_priority::normal, details::to_steady_duration( delay ) };
+}
+
+inline bool thread_pool::schedule_awaitable::await_suspend( std::coroutine_handle<> coroutine )
+{
+    if( m_delay.count() > 0 )
+    {
+        m_pool->post_after( m_delay, resumer{ coroutine, *this } );
+    }
+    else
+    {
+        m_pool->post( m_priority, resumer{ coroutine, *this } );
+    }
+
+    // Nothing may be touched after this, once the resumer is handed over it may resume and destroy the coroutine
+    return !m_handed_over.exchange( true, std::memory_order_acq_rel );
+}
+
+inline void thread_pool::schedule_awaitable::await_resume() const
+{
+    if( m_dropped )
+    {
+        throw std::future_error{ std::future_errc::broken_promise };
+    }
+}
+#endif
+
 template< typename TimeoutType >
 bool thread_pool::wait_until_finished( const TimeoutType& timeout ) const
 {
     static_assert( type_traits::is_duration< TimeoutType >::value, "Timeout should be of type std::chrono" );
 
+    if( !m_tasks_number )
+    {
+        return true;
+    }
+
     bool result{ true };
 
-    std::unique_lock< std::mutex > l{ m_tasks_mutex };
+    // Registered before the check, so that the finishing worker either sees the waiter or the waiter sees no tasks
+    std::unique_lock< std::mutex > l{ m_status_mutex };
+    ++m_status_waiters;
 
-    if( m_tasks_number )
+    if( timeout.count() )
     {
-        if( timeout.count() )
-        {
-            result = m_tasks_status_cv.wait_for( l, timeout, [ this ](){ return !m_tasks_number; } );
-        }
-        else
-        {
-            m_tasks_status_cv.wait( l, [ this ](){ return !m_tasks_number; } );
-        }
+        result = m_tasks_status_cv.wait_for( l, timeout, [ this ](){ return !m_tasks_number; } );
     }
+    else
+    {
+        m_tasks_status_cv.wait( l, [ this ](){ return !m_tasks_number; } );
+    }
+
+    --m_status_waiters;
 
     return result;
 }
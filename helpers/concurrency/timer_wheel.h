@@ -0,0 +1,384 @@
+#ifndef HELPERS_TIMER_WHEEL
+#define HELPERS_TIMER_WHEEL
+
+#include <array>
+#include <chrono>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <stdexcept>
+
+#include "../temporal/temporal.h"
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+using timer_id = uint64_t;
+
+/// \class timer_wheel
+/// Hierarchical timer wheel of 11 levels by 64 slots covering the whole 64 bit range of ticks.
+/// A timer goes to the level of the highest 6 bit digit its expiry differs from the current tick in,
+/// when the wheel reaches its slot the timer is moved a level down until it expires at level 0.
+/// Adding and cancelling a timer is O(1), empty stretches of time are skipped with the slots' bitmaps.
+/// Not thread-safe
+template< typename T >
+class timer_wheel
+{
+public:
+    using tick_type = uint64_t;
+
+    static constexpr size_t slot_bits{ 6 };
+    static constexpr size_t slots_number{ 1 << slot_bits };
+    static constexpr size_t levels_number{ ( 64 + slot_bits - 1 ) / slot_bits };
+    static constexpr tick_type never{ std::numeric_limits< tick_type >::max() };
+
+    explicit timer_wheel( tick_type now = 0 ) noexcept : m_now( now ){ m_heads.fill( npos ); }
+
+    // Timer expiring at the tick, an expiry not after now() is moved to the next tick.
+    // A periodic timer expires every period ticks until cancelled, missed periods are skipped
+    timer_id add( tick_type expiry, T value, tick_type period = 0 );
+
+    // Returns false if there's no such timer, it has expired or was cancelled already
+    bool cancel( timer_id id );
+
+    // Moves the wheel to the tick, calling on_expired( T& ) for each expired timer in the order of expiry.
+    // Values of one-shot timers are destroyed right after the call, so they may be moved from
+    template< typename Func >
+    void advance( tick_type now, Func&& on_expired );
+
+    // Tick at which advance() has something to do, never if there are no timers
+    tick_type next_event() const noexcept;
+
+    tick_type now() const noexcept{ return m_now; }
+    size_t size() const noexcept{ return m_size; }
+    bool empty() const noexcept{ return !m_size; }
+
+private:
+    using index_type = uint32_t;
+    static constexpr index_type npos{ std::numeric_limits< index_type >::max() };
+
+    struct node
+    {
+        T value;
+        tick_type expiry{ 0 };
+        tick_type period{ 0 };
+        uint32_t generation{ 0 };
+        index_type prev{ npos };
+        index_type next{ npos };
+        uint16_t slot{ 0 };
+        bool used{ false };
+    };
+
+    void link( index_type index );
+    void unlink( index_type index ) noexcept;
+    void release( index_type index ) noexcept;
+    index_type take_slot( size_t slot ) noexcept;
+    void process_tick( std::vector< index_type >& expired );
+
+    static size_t lowest_bit( uint64_t value ) noexcept;
+    static tick_type level_base( tick_type tick, size_t level ) noexcept;
+
+private:
+    tick_type m_now;
+    size_t m_size{ 0 };
+
+    std::vector< node > m_nodes;
+    index_type m_free{ npos };
+
+    // Slot heads of all levels one after another, a bit per non-empty slot of each level
+    std::array< index_type, levels_number * slots_number > m_heads;
+    std::array< uint64_t, levels_number > m_occupied{};
+};
+
+namespace details
+{
+
+// Conversions of std::chrono and temporal::details::time_ratio durations and time points
+// to steady_clock, time_ratio time points are absolute like the ones time_ratio::now() returns
+
+template< typename Rep, typename Period >
+std::chrono::steady_clock::duration to_steady_duration( const std::chrono::duration< Rep, Period >& d )
+{
+    return std::chrono::duration_cast< std::chrono::steady_clock::duration >( d );
+}
+
+template< temporal::time_type tick_cnt, temporal::time_type period >
+std::chrono::steady_clock::duration to_steady_duration( const temporal::details::time_ratio< tick_cnt, period >& d )
+{
+    return to_steady_duration( std::chrono::duration< temporal::time_type, std::ratio< period, tick_cnt > >{ d.count() } );
+}
+
+inline std::chrono::steady_clock::time_point to_steady_time( const std::chrono::steady_clock::time_point& t )
+{
+    return t;
+}
+
+template< typename Clock, typename Duration >
+std::chrono::steady_clock::time_point to_steady_time( const std::chrono::time_point< Clock, Duration >& t )
+{
+    return std::chrono::steady_clock::now() + to_steady_duration( t - Clock::now() );
+}
+
+template< temporal::time_type tick_cnt, temporal::time_type period >
+std::chrono::steady_clock::time_point to_steady_time( const temporal::details::time_ratio< tick_cnt, period >& t )
+{
+    using since_epoch = std::chrono::duration< temporal::time_type, std::ratio< period, tick_cnt > >;
+
+    return to_steady_time( std::chrono::system_clock::time_point{} +
+                           std::chrono::duration_cast< std::chrono::system_clock::duration >( since_epoch{ t.count_since_epoch() } ) );
+}
+
+}// details
+
+///// implementation
+
+template< typename T >
+constexpr typename timer_wheel< T >::tick_type timer_wheel< T >::never;
+
+template< typename T >
+constexpr typename timer_wheel< T >::index_type timer_wheel< T >::npos;
+
+template< typename T >
+timer_id timer_wheel< T >::add( tick_type expiry, T value, tick_type period )
+{
+    index_type index{ m_free };
+
+    if( index == npos )
+    {
+        if( m_nodes.size() >= npos )
+        {
+            throw std::length_error{ "Too many timers" };
+        }
+
+        index = static_cast< index_type >( m_nodes.size() );
+        m_nodes.emplace_back();
+    }
+    else
+    {
+        m_free = m_nodes[ index ].next;
+    }
+
+    node& n = m_nodes[ index ];
+    n.value = std::move( value );
+    n.expiry = expiry > m_now ? expiry : m_now + 1;
+    n.period = period;
+    n.used = true;
+    ++n.generation;
+
+    link( index );
+    ++m_size;
+
+    return ( static_cast< timer_id >( n.generation ) << 32 ) | index;
+}
+
+template< typename T >
+bool timer_wheel< T >::cancel( timer_id id )
+{
+    const index_type index{ static_cast< index_type >( id ) };
+
+    if( index >= m_nodes.size() || !m_nodes[ index ].used || m_nodes[ index ].generation != static_cast< uint32_t >( id >> 32 ) )
+    {
+        return false;
+    }
+
+    unlink( index );
+    release( index );
+
+    return true;
+}
+
+template< typename T >
+template< typename Func >
+void timer_wheel< T >::advance( tick_type now, Func&& on_expired )
+{
+    std::vector< index_type > expired;
+
+    for( tick_type next{ next_event() }; next <= now; next = next_event() )
+    {
+        m_now = next;
+        process_tick( expired );
+
+        for( auto index : expired )
+        {
+            node& n = m_nodes[ index ];
+            on_expired( n.value );
+
+            if( n.period )
+            {
+                // Fixed rate, the periods missed by the time the wheel is moved to are skipped
+                n.expiry += ( ( now - n.expiry ) / n.period + 1 ) * n.period;
+                link( index );
+            }
+            else
+            {
+                release( index );
+            }
+        }
+
+        expired.clear();
+    }
+
+    if( now > m_now )
+    {
+        m_now = now;
+    }
+}
+
+template< typename T >
+auto timer_wheel< T >::next_event() const noexcept -> tick_type
+{
+    // Events of a level come after all events of the lower levels, so the lowest non-empty level wins
+    for( size_t level{ 0 }; level < levels_number; ++level )
+    {
+        const size_t shift{ level * slot_bits };
+        const size_t current{ static_cast< size_t >( m_now >> shift ) & ( slots_number - 1 ) };
+        const uint64_t ahead{ current + 1 < slots_number ? m_occupied[ level ] & ( ~uint64_t{ 0 } << ( current + 1 ) ) : 0 };
+
+        if( ahead )
+        {
+            return level_base( m_now, level + 1 ) | ( static_cast< tick_type >( lowest_bit( ahead ) ) << shift );
+        }
+    }
+
+    return never;
+}
+
+template< typename T >
+void timer_wheel< T >::link( index_type index )
+{
+    node& n = m_nodes[ index ];
+
+    // Highest differing digit of the expiry and the current tick, 0 if they're equal
+    const tick_type difference{ n.expiry ^ m_now };
+    size_t level{ 0 };
+
+    while( level + 1 < levels_number && ( difference >> ( ( level + 1 ) * slot_bits ) ) )
+    {
+        ++level;
+    }
+
+    const size_t slot_in_level{ static_cast< size_t >( n.expiry >> ( level * slot_bits ) ) & ( slots_number - 1 ) };
+    const size_t slot{ level * slots_number + slot_in_level };
+
+    n.slot = static_cast< uint16_t >( slot );
+    n.prev = npos;
+    n.next = m_heads[ slot ];
+
+    if( n.next != npos )
+    {
+        m_nodes[ n.next ].prev = index;
+    }
+
+    m_heads[ slot ] = index;
+    m_occupied[ level ] |= uint64_t{ 1 } << slot_in_level;
+}
+
+template< typename T >
+void timer_wheel< T >::unlink( index_type index ) noexcept
+{
+    node& n = m_nodes[ index ];
+
+    if( n.prev != npos )
+    {
+        m_nodes[ n.prev ].next = n.next;
+    }
+    else
+    {
+        m_heads[ n.slot ] = n.next;
+    }
+
+    if( n.next != npos )
+    {
+        m_nodes[ n.next ].prev = n.prev;
+    }
+
+    if( m_heads[ n.slot ] == npos )
+    {
+        m_occupied[ n.slot / slots_number ] &= ~( uint64_t{ 1 } << ( n.slot % slots_number ) );
+    }
+}
+
+template< typename T >
+void timer_wheel< T >::release( index_type index ) noexcept
+{
+    node& n = m_nodes[ index ];
+
+    n.value = T{};
+    n.used = false;
+    n.next = m_free;
+    m_free = index;
+
+    --m_size;
+}
+
+template< typename T >
+auto timer_wheel< T >::take_slot( size_t slot ) noexcept -> index_type
+{
+    const index_type head{ m_heads[ slot ] };
+
+    m_heads[ slot ] = npos;
+    m_occupied[ slot / slots_number ] &= ~( uint64_t{ 1 } << ( slot % slots_number ) );
+
+    return head;
+}
+
+template< typename T >
+void timer_wheel< T >::process_tick( std::vector< index_type >& expired )
+{
+    // Slots of the higher levels reached at this tick are moved down, from the top so that
+    // a timer can fall through several levels at once
+    for( size_t level{ levels_number - 1 }; level > 0; --level )
+    {
+        const size_t shift{ level * slot_bits };
+
+        if( !( m_now & ( ( tick_type{ 1 } << shift ) - 1 ) ) )
+        {
+            const size_t slot{ level * slots_number + ( static_cast< size_t >( m_now >> shift ) & ( slots_number - 1 ) ) };
+
+            for( index_type index{ take_slot( slot ) }; index != npos; )
+            {
+                const index_type next{ m_nodes[ index ].next };
+                link( index );
+                index = next;
+            }
+        }
+    }
+
+    for( index_type index{ take_slot( static_cast< size_t >( m_now ) & ( slots_number - 1 ) ) }; index != npos; index = m_nodes[ index ].next )
+    {
+        expired.emplace_back( index );
+    }
+}
+
+template< typename T >
+size_t timer_wheel< T >::lowest_bit( uint64_t value ) noexcept
+{
+#ifdef __GNUC__
+    return static_cast< size_t >( __builtin_ctzll( value ) );
+#else
+    size_t bit{ 0 };
+    while( !( value & 1 ) )
+    {
+        value >>= 1;
+        ++bit;
+    }
+
+    return bit;
+#endif
+}
+
+template< typename T >
+auto timer_wheel< T >::level_base( tick_type tick, size_t level ) noexcept -> tick_type
+{
+    const size_t shift{ level * slot_bits };
+    return shift < 64 ? ( tick >> shift ) << shift : 0;
+}
+
+}// concurrency
+
+}// helpers
+
+#endif
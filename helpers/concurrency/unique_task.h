@@ -0,0 +1,216 @@
+#ifndef HELPERS_UNIQUE_TASK
+#define HELPERS_UNIQUE_TASK
+
+#include <new>
+#include <future>
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+
+namespace helpers
+{
+
+namespace concurrency
+{
+
+/// \class unique_task
+/// A move-only type erased void() callable.
+/// Callables of up to inline_capacity bytes with noexcept move constructor
+/// are stored inside the object, the rest are allocated on the heap
+class unique_task
+{
+public:
+    static constexpr size_t inline_capacity{ 64 };
+
+    unique_task() noexcept = default;
+    unique_task( std::nullptr_t ) noexcept{}
+
+    template< typename Func,
+              typename = typename std::enable_if< !std::is_same< typename std::decay< Func >::type, unique_task >::value >::type >
+    unique_task( Func&& func )
+    {
+        using func_type = typename std::decay< Func >::type;
+        using storage_type = typename std::conditional< stored_inline< func_type >(),
+                                                        inline_storage< func_type >,
+                                                        heap_storage< func_type > >::type;
+
+        storage_type::create( &m_storage, std::forward< Func >( func ) );
+        m_ops = &storage_type::ops;
+    }
+
+    unique_task( unique_task&& other ) noexcept
+    {
+        move_from( other );
+    }
+
+    unique_task& operator=( unique_task&& other ) noexcept
+    {
+        if( this != &other )
+        {
+            reset();
+            move_from( other );
+        }
+
+        return *this;
+    }
+
+    unique_task& operator=( std::nullptr_t ) noexcept
+    {
+        reset();
+        return *this;
+    }
+
+    unique_task( const unique_task& ) = delete;
+    unique_task& operator=( const unique_task& ) = delete;
+
+    ~unique_task(){ reset(); }
+
+    // Throws std::bad_function_call if empty
+    void operator()()
+    {
+        if( !m_ops )
+        {
+            throw std::bad_function_call{};
+        }
+
+        m_ops->invoke( &m_storage );
+    }
+
+    explicit operator bool() const noexcept{ return m_ops != nullptr; }
+
+    void reset() noexcept
+    {
+        if( m_ops )
+        {
+            m_ops->destroy( &m_storage );
+            m_ops = nullptr;
+        }
+    }
+
+private:
+    using storage = typename std::aligned_storage< inline_capacity, alignof( std::max_align_t ) >::type;
+
+    struct operations
+    {
+        void( *invoke )( storage* );
+        void( *move )( storage* to, storage* from ) noexcept;
+        void( *destroy )( storage* ) noexcept;
+    };
+
+    template< typename Func >
+    static constexpr bool stored_inline()
+    {
+        return sizeof( Func ) <= inline_capacity &&
+               alignof( Func ) <= alignof( storage ) &&
+               std::is_nothrow_move_constructible< Func >::value;
+    }
+
+    template< typename Func >
+    struct inline_storage
+    {
+        template< typename F >
+        static void create( storage* s, F&& f ){ new( s ) Func( std::forward< F >( f ) ); }
+
+        static Func* get( storage* s ) noexcept{ return reinterpret_cast< Func* >( s ); }
+
+        static void invoke( storage* s ){ ( *get( s ) )(); }
+
+        static void move( storage* to, storage* from ) noexcept
+        {
+            new( to ) Func( std::move( *get( from ) ) );
+            get( from )->~Func();
+        }
+
+        static void destroy( storage* s ) noexcept{ get( s )->~Func(); }
+
+        static const operations ops;
+    };
+
+    template< typename Func >
+    struct heap_storage
+    {
+        template< typename F >
+        static void create( storage* s, F&& f ){ new( s ) Func*( new Func( std::forward< F >( f ) ) ); }
+
+        static Func*& get( storage* s ) noexcept{ return *reinterpret_cast< Func** >( s ); }
+
+        static void invoke( storage* s ){ ( *get( s ) )(); }
+
+        static void move( storage* to, storage* from ) noexcept{ new( to ) Func*( get( from ) ); }
+
+        static void destroy( storage* s ) noexcept{ delete get( s ); }
+
+        static const operations ops;
+    };
+
+    void move_from( unique_task& other ) noexcept
+    {
+        if( other.m_ops )
+        {
+            other.m_ops->move( &m_storage, &other.m_storage );
+            m_ops = other.m_ops;
+            other.m_ops = nullptr;
+        }
+    }
+
+private:
+    storage m_storage;
+    const operations* m_ops{ nullptr };
+};
+
+template< typename Func >
+const unique_task::operations unique_task::inline_storage< Func >::ops{ &invoke, &move, &destroy };
+
+template< typename Func >
+const unique_task::operations unique_task::heap_storage< Func >::ops{ &invoke, &move, &destroy };
+
+namespace details
+{
+
+/// \class promised_task
+/// Callable owning the promise of its own result, so that the result
+/// can be delivered without any extra shared state around the task
+template< typename Result, typename Callable >
+class promised_task
+{
+public:
+    explicit promised_task( Callable&& callable ) : m_callable( std::move( callable ) ){}
+
+    std::future< Result > get_future(){ return m_promise.get_future(); }
+
+    void operator()()
+    {
+        try
+        {
+            set_result( std::is_void< Result >{} );
+        }
+        catch( ... )
+        {
+            m_promise.set_exception( std::current_exception() );
+        }
+    }
+
+private:
+    void set_result( std::true_type )
+    {
+        m_callable();
+        m_promise.set_value();
+    }
+
+    void set_result( std::false_type )
+    {
+        m_promise.set_value( m_callable() );
+    }
+
+private:
+    Callable m_callable;
+    std::promise< Result > m_promise;
+};
+
+}// details
+
+}// concurrency
+
+}// helpers
+
+#endif
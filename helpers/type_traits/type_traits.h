@@ -25,8 +25,8 @@ template<typename T, typename... Types>
 struct is_any_of
 {
     static constexpr bool any_of{ std::is_base_of<
-              detail::wrap<T>,
-              detail::inherit<Types...>>::value };
+              details::wrap<T>,
+              details::inherit<Types...>>::value };
 };
 
 template< typename >
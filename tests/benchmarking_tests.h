@@ -39,13 +39,13 @@ TEST_CASE( scope_time_handle_test )
 
     auto test_func = [ &result ]()
     {
-        millisec_scope_time_handle m{ [ &result ]( const dur_type& d ){ result = d; } };
+        millisec_scoped_time_handle m{ [ &result ]( const dur_type& d ){ result = d; } };
         std::this_thread::sleep_for( std::chrono::milliseconds{ 100 } );
     };
 
-    millisec_scope_time_handle::pred_type p_uninit;
+    millisec_scoped_time_handle::pred_type p_uninit;
 
-    CHECK_THROW( millisec_scope_time_handle h1{ p_uninit } )
+    CHECK_THROW( millisec_scoped_time_handle h1{ p_uninit } )
     CHECK_NOTHROW( test_func() )
     DYNAMIC_ASSERT( result.count() >= 99 && result.count() <=101 )
 }
@@ -8,6 +8,20 @@
 
 #include "test.h"
 #include "thread_pool.h"
+#include "unique_task.h"
+#include "mpmc_queue.h"
+#include "cpu_topology.h"
+#include "task_graph.h"
+#include "task_group.h"
+#include "strand.h"
+#include "pool_future.h"
+#include "pool_scaler.h"
+#include "pool_stats.h"
+#include "cancellation.h"
+#include "timer_wheel.h"
+#include "coroutine_task.h"
+#include "temporal.h"
+#include "parallel_algorithms.h"
 #include "atomic_locks.h"
 
 using namespace helpers::concurrency;
@@ -84,6 +98,1787 @@ TEST_CASE( thread_pool_test )
     DYNAMIC_ASSERT( workers_number == 2 );
 }
 
+TEST_CASE( thread_pool_work_stealing_test )
+{
+    thread_pool t{ 2, scheduling_policy::work_stealing };
+    DYNAMIC_ASSERT( t.policy() == scheduling_policy::work_stealing )
+
+    std::atomic< int > sum{ 0 };
+
+    // Subtasks land in the parent worker's own queue, the parent blocks,
+    // so they can only be finished by the other worker stealing them
+    auto parent = t.add_task( [ &t, &sum ]()
+    {
+        std::vector< std::future< void > > children;
+        for( int i{ 1 }; i <= 10; ++i )
+        {
+            children.emplace_back( t.add_task( [ &sum ]( int v ){ sum += v; }, i ) );
+        }
+
+        for( auto& c : children )
+        {
+            if( c.wait_for( std::chrono::seconds{ 5 } ) != std::future_status::ready )
+            {
+                return false;
+            }
+        }
+
+        return true;
+    } );
+
+    DYNAMIC_ASSERT( parent.get() )
+    DYNAMIC_ASSERT( sum == 55 )
+    DYNAMIC_ASSERT( t.wait_until_finished( std::chrono::seconds{ 5 } ) )
+    DYNAMIC_ASSERT( !t.total_tasks_number() && !t.queue_size() )
+
+    // Tasks left in a removed worker's queue are still executed
+    CHECK_NOTHROW( t.add_workers( 1 ) )
+    CHECK_NOTHROW( t.schedule_remove_workers( 2 ) )
+
+    for( int i{ 0 }; i < 10; ++i )
+    {
+        t.add_task( [ &t, &sum ](){ t.add_task( [ &sum ](){ --sum; } ); } );
+    }
+
+    DYNAMIC_ASSERT( t.wait_until_finished( std::chrono::seconds{ 5 } ) )
+    DYNAMIC_ASSERT( sum == 45 )
+    DYNAMIC_ASSERT( t.workers_number() == 1 )
+}
+
+TEST_CASE( thread_pool_add_tasks_test )
+{
+    thread_pool t{ 2 };
+
+    std::vector< std::function< int() > > funcs;
+    for( int i{ 0 }; i < 100; ++i )
+    {
+        funcs.emplace_back( [ i ](){ return i * 2; } );
+    }
+
+    std::vector< std::future< int > > futures;
+    CHECK_NOTHROW( futures = t.add_tasks( funcs.begin(), funcs.end() ) )
+    DYNAMIC_ASSERT( futures.size() == funcs.size() )
+
+    for( size_t i{ 0 }; i < futures.size(); ++i )
+    {
+        DYNAMIC_ASSERT( futures[ i ].get() == static_cast< int >( i ) * 2 )
+    }
+
+    std::atomic< int > sum{ 0 };
+    auto void_futures = t.add_tasks( 0, 100, [ &sum ]( int i ){ sum += i; } );
+    DYNAMIC_ASSERT( void_futures.size() == 100 )
+    DYNAMIC_ASSERT( t.add_tasks( 10, 0, []( int ){} ).empty() )
+
+    DYNAMIC_ASSERT( t.wait_until_finished( std::chrono::seconds{ 5 } ) )
+    DYNAMIC_ASSERT( sum == 4950 )
+
+    // Batch added from a worker goes to its own queue
+    thread_pool ws{ 2, scheduling_policy::work_stealing };
+    auto nested = ws.add_task( [ &ws ]()
+    {
+        auto squares = ws.add_tasks( 0, 10, []( int i ){ return i * i; } );
+        int result{ 0 };
+        for( auto& f : squares )
+        {
+            result += f.get();
+        }
+
+        return result;
+    } );
+
+    DYNAMIC_ASSERT( nested.get() == 285 )
+}
+
+TEST_CASE( thread_pool_priority_test )
+{
+    auto run_order = []( size_t aging_limit )
+    {
+        thread_pool t{ 1 };
+        t.set_aging_limit( aging_limit );
+
+        std::promise< void > gate;
+        std::atomic_bool started{ false };
+        auto gate_future = gate.get_future().share();
+        t.add_task( [ gate_future, &started ](){ started = true; gate_future.wait(); } );
+
+        while( !started )
+        {
+            std::this_thread::yield();
+        }
+
+        std::mutex m;
+        std::string order;
+        auto record = [ &m, &order ]( char c ){ std::lock_guard< std::mutex > l{ m }; order += c; };
+
+        for( int i{ 0 }; i < 3; ++i )
+        {
+            t.add_task( task_priority::low, record, 'l' );
+            t.add_task( record, 'n' );
+            t.add_task( task_priority::high, record, 'h' );
+        }
+
+        DYNAMIC_ASSERT( t.queue_size() == 9 )
+        DYNAMIC_ASSERT( t.queue_size( task_priority::high ) == 3 )
+        DYNAMIC_ASSERT( t.queue_size( task_priority::normal ) == 3 )
+        DYNAMIC_ASSERT( t.queue_size( task_priority::low ) == 3 )
+
+        gate.set_value();
+        t.wait_until_finished();
+
+        return order;
+    };
+
+    DYNAMIC_ASSERT( run_order( 0 ) == "hhhnnnlll" )
+
+    // A low priority task goes ahead once it was passed over twice
+    std::string aged;
+    CHECK_NOTHROW( aged = run_order( 2 ) )
+    DYNAMIC_ASSERT( aged.size() == 9 )
+    DYNAMIC_ASSERT( aged.find( 'l' ) < aged.rfind( 'h' ) )
+}
+
+TEST_CASE( mpmc_queue_test )
+{
+    CHECK_THROW( ( mpmc_queue< int >{ 1 } ) )
+
+    mpmc_queue< std::unique_ptr< int > > q{ 3 };
+    DYNAMIC_ASSERT( q.capacity() == 4 )
+
+    std::unique_ptr< int > value;
+    DYNAMIC_ASSERT( !q.try_pop( value ) )
+
+    for( int i{ 0 }; i < 4; ++i )
+    {
+        DYNAMIC_ASSERT( q.try_emplace( new int{ i } ) )
+    }
+
+    std::unique_ptr< int > extra{ new int{ 4 } };
+    DYNAMIC_ASSERT( !q.try_push( std::move( extra ) ) )
+    DYNAMIC_ASSERT( extra && *extra == 4 )
+    DYNAMIC_ASSERT( q.size_approx() == 4 )
+
+    DYNAMIC_ASSERT( q.try_pop( value ) && *value == 0 )
+    DYNAMIC_ASSERT( q.try_push( std::move( extra ) ) )
+
+    for( int i{ 1 }; i < 5; ++i )
+    {
+        DYNAMIC_ASSERT( q.try_pop( value ) && *value == i )
+    }
+
+    DYNAMIC_ASSERT( !q.try_pop( value ) )
+
+    // Several producers and consumers through a small ring
+    mpmc_queue< size_t > numbers{ 16 };
+    const size_t per_producer{ 10000 };
+    std::atomic< size_t > sum{ 0 };
+    std::atomic< size_t > popped{ 0 };
+    std::vector< std::thread > threads;
+
+    for( size_t p{ 0 }; p < 2; ++p )
+    {
+        threads.emplace_back( [ &numbers, per_producer ](){
+            for( size_t i{ 1 }; i <= per_producer; ++i )
+            {
+                while( !numbers.try_push( i ) )
+                {
+                    std::this_thread::yield();
+                }
+            }
+        } );
+    }
+
+    for( size_t c{ 0 }; c < 2; ++c )
+    {
+        threads.emplace_back( [ &numbers, &sum, &popped, per_producer ](){
+            size_t number{ 0 };
+            while( popped < 2 * per_producer )
+            {
+                if( numbers.try_pop( number ) )
+                {
+                    sum += number;
+                    ++popped;
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+        } );
+    }
+
+    for( auto& thread : threads )
+    {
+        thread.join();
+    }
+
+    DYNAMIC_ASSERT( sum == per_producer * ( per_producer + 1 ) )
+
+    // Thread pool backend, overflowing the ring
+    thread_pool t{ 2, scheduling_policy::shared_queue, queue_backend::lock_free };
+    DYNAMIC_ASSERT( t.backend() == queue_backend::lock_free )
+
+    std::atomic< size_t > done{ 0 };
+    const size_t tasks_number{ thread_pool::lock_free_queue_capacity * 2 };
+    std::vector< std::future< void > > futures;
+
+    for( size_t i{ 0 }; i < tasks_number; ++i )
+    {
+        futures.emplace_back( t.add_task( [ &done ](){ ++done; } ) );
+    }
+
+    t.add_task( task_priority::low, [ &done ](){ ++done; } );
+    t.wait_until_finished();
+
+    DYNAMIC_ASSERT( done == tasks_number + 1 )
+    DYNAMIC_ASSERT( t.queue_size() == 0 )
+
+    for( auto& f : futures )
+    {
+        CHECK_NOTHROW( f.get() )
+    }
+
+    // Pending tasks are dropped from the ring too
+    thread_pool single{ 1, scheduling_policy::shared_queue, queue_backend::lock_free };
+
+    std::promise< void > gate;
+    std::atomic_bool started{ false };
+    auto gate_future = gate.get_future().share();
+    single.add_task( [ gate_future, &started ](){ started = true; gate_future.wait(); } );
+
+    while( !started )
+    {
+        std::this_thread::yield();
+    }
+
+    single.add_task( [](){} );
+    single.add_task( [](){} );
+    DYNAMIC_ASSERT( single.queue_size() == 2 )
+
+    single.clean_pending_tasks();
+    DYNAMIC_ASSERT( single.queue_size() == 0 )
+
+    gate.set_value();
+    single.wait_until_finished();
+    DYNAMIC_ASSERT( single.total_tasks_number() == 0 )
+}
+
+TEST_CASE( task_graph_test )
+{
+    // A single worker must not deadlock on a deep graph
+    thread_pool t{ 1 };
+
+    std::mutex m;
+    std::string order;
+    auto record = [ &m, &order ]( char c ){ std::lock_guard< std::mutex > l{ m }; order += c; };
+
+    task_graph g;
+    const auto a = g.add_node( std::bind( record, 'a' ) );
+    const auto b = g.add_node( std::bind( record, 'b' ), { a } );
+    const auto c = g.add_node( std::bind( record, 'c' ), { a } );
+    const auto d = g.add_node( std::bind( record, 'd' ), { b, c } );
+    DYNAMIC_ASSERT( g.size() == 4 )
+
+    CHECK_THROW( g.add_dependency( d, 10 ) )
+    CHECK_THROW( g.add_dependency( d, d ) )
+
+    // The graph is reusable
+    for( int run{ 0 }; run < 3; ++run )
+    {
+        order.clear();
+        auto f = g.run( t );
+        CHECK_NOTHROW( f.get() )
+        DYNAMIC_ASSERT( !g.is_running() )
+        DYNAMIC_ASSERT( order.size() == 4 )
+        DYNAMIC_ASSERT( order.front() == 'a' && order.back() == 'd' )
+    }
+
+    // Wide graph, the ready nodes are posted from the workers
+    thread_pool stealing{ 3, scheduling_policy::work_stealing };
+    task_graph wide;
+    std::atomic< int > counter{ 0 };
+    std::promise< void > gate;
+    auto gate_future = gate.get_future().share();
+    const auto root = wide.add_node( [ &counter, gate_future ](){ gate_future.wait(); ++counter; } );
+    std::vector< task_graph::node_id > leaves;
+
+    for( int i{ 0 }; i < 100; ++i )
+    {
+        leaves.emplace_back( wide.add_node( [ &counter ](){ ++counter; }, { root } ) );
+    }
+
+    int checked{ -1 };
+    const auto sink = wide.add_node( [ &counter, &checked ](){ checked = counter; } );
+    for( auto leaf : leaves )
+    {
+        wide.add_dependency( leaf, sink );
+    }
+
+    auto wide_future = wide.run( stealing );
+    CHECK_THROW( wide.run( stealing ) )
+    CHECK_THROW( wide.add_node( [](){} ) )
+    gate.set_value();
+    CHECK_NOTHROW( wide_future.get() )
+    DYNAMIC_ASSERT( checked == 101 )
+
+    // An exception skips the rest of the nodes
+    task_graph failing;
+    bool skipped{ true };
+    const auto thrower = failing.add_node( [](){ throw std::runtime_error{ "node failed" }; } );
+    failing.add_node( [ &skipped ](){ skipped = false; }, { thrower } );
+
+    auto failed_future = failing.run( t );
+    CHECK_THROW( failed_future.get() )
+    DYNAMIC_ASSERT( skipped )
+
+    // Cycles are detected when run
+    task_graph cyclic;
+    const auto first = cyclic.add_node( [](){} );
+    const auto second = cyclic.add_node( [](){}, { first } );
+    cyclic.add_dependency( second, first );
+    CHECK_THROW( cyclic.run( t ) )
+
+    // An empty graph is finished right away
+    task_graph empty;
+    auto empty_future = empty.run( t );
+    CHECK_NOTHROW( empty_future.get() )
+
+    // Nodes dropped by the pool fail the graph instead of leaving it running
+    {
+        thread_pool limited{ 1 };
+        std::promise< void > started;
+        std::promise< void > release;
+        std::shared_future< void > released{ release.get_future() };
+        limited.post( [ & ](){ started.set_value(); released.wait(); } );
+        started.get_future().wait();
+
+        queue_limit limit;
+        limit.capacity = 1;
+        limit.policy = overflow_policy::reject;
+        limited.set_queue_limit( limit );
+        limited.post( [](){} );
+
+        std::atomic< int > ran{ 0 };
+        task_graph dropped;
+        const auto dropped_root = dropped.add_node( [ &ran ](){ ++ran; } );
+        dropped.add_node( [ &ran ](){ ++ran; }, { dropped_root } );
+
+        auto dropped_future = dropped.run( limited );
+        DYNAMIC_ASSERT( !dropped.is_running() )
+
+        bool broken{ false };
+        try
+        {
+            dropped_future.get();
+        }
+        catch( const std::future_error& e )
+        {
+            broken = e.code() == std::future_errc::broken_promise;
+        }
+
+        DYNAMIC_ASSERT( broken && ran == 0 )
+
+        // The graph can be run again once there's room
+        release.set_value();
+        limited.wait_until_finished();
+
+        CHECK_NOTHROW( dropped.run( limited ).get() )
+        DYNAMIC_ASSERT( ran == 2 )
+    }
+
+    // Posted tasks have no future and their exceptions don't stop the workers
+    std::atomic< int > posted{ 0 };
+    t.post( [](){ throw std::runtime_error{ "ignored" }; } );
+    t.post( [ &posted ]( int value ){ posted += value; }, 2 );
+    t.post( task_priority::high, [ &posted ](){ ++posted; } );
+    t.wait_until_finished();
+    DYNAMIC_ASSERT( posted == 3 )
+}
+
+// Continuation whose copies and moves throw once armed, so that posting it to the pool fails
+struct throwing_move_continuation
+{
+    explicit throwing_move_continuation( std::shared_ptr< std::atomic_bool > is_armed ) : armed( std::move( is_armed ) ){}
+    throwing_move_continuation( const throwing_move_continuation& other ) : armed( other.armed ){ check(); }
+    throwing_move_continuation( throwing_move_continuation&& other ) : armed( other.armed ){ check(); }
+
+    void check() const
+    {
+        if( *armed )
+        {
+            throw std::runtime_error{ "Can't move" };
+        }
+    }
+
+    int operator()( int value ) const{ return value; }
+
+    std::shared_ptr< std::atomic_bool > armed;
+};
+
+TEST_CASE( pool_future_test )
+{
+    thread_pool t{ 2 };
+
+    pool_future< int > empty;
+    DYNAMIC_ASSERT( !empty.valid() )
+    CHECK_THROW( empty.get() )
+
+    // Chained continuations, each one posted to the pool
+    auto f = async_task( t, []( int a, int b ){ return a + b; }, 1, 2 )
+             .then( []( int value ){ return value * 10; } )
+             .then( []( int value ){ return std::to_string( value ); } );
+
+    DYNAMIC_ASSERT( f.get() == "30" )
+    DYNAMIC_ASSERT( f.is_ready() )
+
+    // Continuation attached to a ready future
+    std::atomic< int > calls{ 0 };
+    auto v = f.then( [ &calls ]( const std::string& ){ ++calls; } );
+    CHECK_NOTHROW( v.get() )
+    auto after_void = v.then( [ &calls ](){ ++calls; return 5; } );
+    DYNAMIC_ASSERT( after_void.get() == 5 )
+    DYNAMIC_ASSERT( calls == 2 )
+
+    // Exceptions skip the continuations
+    bool called{ false };
+    auto failed = async_task( t, []() -> int { throw std::runtime_error{ "failed" }; } )
+                  .then( [ &called ]( int value ){ called = true; return value; } );
+    CHECK_THROW( failed.get() )
+    DYNAMIC_ASSERT( !called )
+
+    // when_all and when_any
+    std::promise< void > gate;
+    auto gate_future = gate.get_future().share();
+
+    std::vector< pool_future< int > > futures;
+    futures.emplace_back( async_task( t, [](){ return 1; } ) );
+    futures.emplace_back( async_task( t, [ gate_future ](){ gate_future.wait(); return 2; } ) );
+
+    auto any = when_any( futures.begin(), futures.end() );
+    DYNAMIC_ASSERT( any.get() == 0 )
+
+    auto all = when_all( futures.begin(), futures.end() );
+    auto sum = all.then( [ futures ](){ return futures[ 0 ].get() + futures[ 1 ].get(); } );
+    DYNAMIC_ASSERT( !all.wait_for( std::chrono::milliseconds{ 10 } ) )
+
+    gate.set_value();
+    DYNAMIC_ASSERT( sum.get() == 3 )
+
+    futures.emplace_back( failed );
+    auto all_failed = when_all( futures.begin(), futures.end() );
+    CHECK_THROW( all_failed.get() )
+    CHECK_THROW( when_all( futures.end(), futures.end() ) )
+
+    // Tasks dropped from the pool break their futures
+    thread_pool single{ 1 };
+    std::promise< void > single_gate;
+    auto single_future = single_gate.get_future().share();
+    auto blocker = async_task( single, [ single_future ](){ single_future.wait(); } );
+    while( single.queue_size() )
+    {
+        std::this_thread::yield();
+    }
+
+    auto dropped = async_task( single, [](){ return 1; } );
+    auto dropped_next = dropped.then( []( int value ){ return value; } );
+    single.clean_pending_tasks();
+    single_gate.set_value();
+
+    CHECK_THROW( dropped.get() )
+    CHECK_THROW( dropped_next.get() )
+    CHECK_NOTHROW( blocker.get() )
+
+    // A pool destroyed with a pending chain breaks the whole chain, each dropped step posts the next one
+    pool_future< int > chain;
+    std::promise< void > busy_gate;
+    std::thread release;
+
+    {
+        thread_pool busy{ 1 };
+        auto busy_future = busy_gate.get_future().share();
+        busy.post( [ busy_future ](){ busy_future.wait(); } );
+
+        while( busy.queue_size() )
+        {
+            std::this_thread::yield();
+        }
+
+        chain = async_task( busy, [](){ return 1; } )
+                .then( []( int value ){ return value + 1; } )
+                .then( []( int value ){ return value + 1; } )
+                .then( []( int value ){ return value + 1; } );
+
+        // Released once the destructor is waiting for the worker
+        release = std::thread{ [ &busy_gate ]()
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds{ 50 } );
+            busy_gate.set_value();
+        } };
+    }
+
+    release.join();
+    CHECK_THROW( chain.get() )
+
+    // A continuation the pool can't take breaks its own future, the other continuations of the same future still run
+    auto armed = std::make_shared< std::atomic_bool >( false );
+    std::promise< void > post_gate;
+    auto post_future = post_gate.get_future().share();
+    auto source = async_task( t, [ post_future ](){ post_future.wait(); return 1; } );
+    auto unposted = source.then( throwing_move_continuation{ armed } );
+    auto posted = source.then( []( int value ){ return value + 1; } );
+
+    *armed = true;
+    post_gate.set_value();
+
+    DYNAMIC_ASSERT( unposted.wait_for( std::chrono::seconds{ 5 } ) )
+    CHECK_THROW( unposted.get() )
+    DYNAMIC_ASSERT( posted.wait_for( std::chrono::seconds{ 5 } ) )
+    DYNAMIC_ASSERT( posted.get() == 2 )
+    DYNAMIC_ASSERT( source.get() == 1 )
+}
+
+TEST_CASE( thread_pool_placement_test )
+{
+    DYNAMIC_ASSERT( ( cpu_topology::parse_cpu_list( "0-3,8,10-11\n" ) == std::vector< size_t >{ 0, 1, 2, 3, 8, 10, 11 } ) )
+    DYNAMIC_ASSERT( cpu_topology::parse_cpu_list( "" ).empty() )
+
+    cpu_topology topology{ { { 0, { 0, 1 } }, { 1, {} }, { 2, { 4, 5 } } } };
+    DYNAMIC_ASSERT( topology.nodes_number() == 2 )
+    DYNAMIC_ASSERT( topology.cpus_number() == 4 )
+    DYNAMIC_ASSERT( topology.nodes()[ 1 ].id == 2 )
+    DYNAMIC_ASSERT( topology.node_of( 5 ) == 1 )
+    DYNAMIC_ASSERT( topology.node_of( 3 ) == 2 )
+    CHECK_THROW( ( cpu_topology{ { { 0, {} } } } ) )
+
+    const auto& machine = cpu_topology::system();
+    DYNAMIC_ASSERT( machine.nodes_number() > 0 )
+    DYNAMIC_ASSERT( machine.cpus_number() > 0 )
+
+    for( auto placement : { placement_policy::none, placement_policy::cores, placement_policy::nodes } )
+    {
+        thread_pool t{ 2, scheduling_policy::shared_queue, queue_backend::locked, placement };
+        DYNAMIC_ASSERT( t.placement() == placement )
+        DYNAMIC_ASSERT( t.node_steal_delay() == std::chrono::milliseconds{ 1 } )
+
+        // Added workers are placed the same way
+        t.add_workers( 1 );
+
+        // The delay holds back only the other nodes' workers, a node's own parked workers are woken for its tasks
+        // and the tasks of a node without workers are taken by any worker right away
+        t.set_node_steal_delay( std::chrono::seconds{ 30 } );
+        DYNAMIC_ASSERT( t.node_steal_delay() == std::chrono::seconds{ 30 } )
+
+        std::vector< std::future< size_t > > futures;
+
+        for( size_t node{ 0 }; node < machine.nodes_number(); ++node )
+        {
+            for( size_t i{ 0 }; i < 10; ++i )
+            {
+                futures.emplace_back( t.add_task_to_node( node, []( size_t value ){ return value; }, node ) );
+            }
+        }
+
+        CHECK_THROW( t.add_task_to_node( machine.nodes_number(), [](){} ) )
+
+        for( size_t i{ 0 }; i < futures.size(); ++i )
+        {
+            DYNAMIC_ASSERT( futures[ i ].wait_for( std::chrono::seconds{ 10 } ) == std::future_status::ready )
+            DYNAMIC_ASSERT( futures[ i ].get() == i / 10 )
+        }
+
+        t.wait_until_finished();
+        DYNAMIC_ASSERT( t.queue_size() == 0 )
+    }
+
+    // Node tasks are dropped along with the rest
+    thread_pool single{ 1 };
+    std::promise< void > gate;
+    auto gate_future = gate.get_future().share();
+    single.add_task( [ gate_future ](){ gate_future.wait(); } );
+
+    auto dropped = single.add_task_to_node( 0, [](){} );
+    single.clean_pending_tasks();
+    gate.set_value();
+    CHECK_THROW( dropped.get() )
+}
+
+TEST_CASE( pool_scaler_test )
+{
+    thread_pool t{ 1 };
+
+    scaling_options invalid;
+    invalid.min_workers = 0;
+    CHECK_THROW( ( pool_scaler{ t, invalid } ) )
+    invalid.min_workers = 3;
+    invalid.max_workers = 2;
+    CHECK_THROW( ( pool_scaler{ t, invalid } ) )
+
+    scaling_options options;
+    options.min_workers = 2;
+    options.max_workers = 6;
+    options.sample_period = std::chrono::milliseconds{ 2 };
+    options.max_wait = std::chrono::milliseconds{ 1 };
+    options.grow_after = 1;
+    options.shrink_after = 5;
+
+    auto wait_for_workers = [ &t ]( size_t number )
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{ 5 };
+        while( t.workers_number() != number && std::chrono::steady_clock::now() < deadline )
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds{ 1 } );
+        }
+
+        return t.workers_number() == number;
+    };
+
+    pool_scaler scaler{ t, options };
+    DYNAMIC_ASSERT( t.workers_number() == 2 )
+
+    // A burst of slow tasks grows the pool up to the bound
+    std::atomic_bool release{ false };
+    for( int i{ 0 }; i < 100; ++i )
+    {
+        t.post( [ &release ](){
+            while( !release )
+            {
+                std::this_thread::sleep_for( std::chrono::milliseconds{ 1 } );
+            }
+        } );
+    }
+
+    DYNAMIC_ASSERT( wait_for_workers( 6 ) )
+    DYNAMIC_ASSERT( scaler.grow_count() > 0 )
+
+    // Once idle it shrinks back to the lower bound
+    release = true;
+    t.wait_until_finished();
+    DYNAMIC_ASSERT( wait_for_workers( 2 ) )
+    DYNAMIC_ASSERT( scaler.shrink_count() == 4 )
+    DYNAMIC_ASSERT( t.completed_tasks_number() == 100 )
+}
+
+TEST_CASE( thread_pool_stats_test )
+{
+    using std::chrono::nanoseconds;
+
+    DYNAMIC_ASSERT( latency_histogram::bucket_of( nanoseconds{ 0 } ) == 0 )
+    DYNAMIC_ASSERT( latency_histogram::bucket_of( nanoseconds{ 1 } ) == 0 )
+    DYNAMIC_ASSERT( latency_histogram::bucket_of( nanoseconds{ 2 } ) == 1 )
+    DYNAMIC_ASSERT( latency_histogram::bucket_of( nanoseconds{ 1023 } ) == 9 )
+    DYNAMIC_ASSERT( latency_histogram::bucket_of( nanoseconds{ 1024 } ) == 10 )
+
+    latency_histogram h;
+    DYNAMIC_ASSERT( h.percentile( 0.5 ) == nanoseconds{ 0 } )
+
+    for( int i{ 1 }; i <= 100; ++i )
+    {
+        h.add( nanoseconds{ i * 100 } );
+    }
+
+    DYNAMIC_ASSERT( h.count() == 100 )
+    DYNAMIC_ASSERT( h.average() == nanoseconds{ 5050 } )
+    DYNAMIC_ASSERT( h.max() == nanoseconds{ 10000 } )
+    DYNAMIC_ASSERT( h.percentile( 0.5 ) >= nanoseconds{ 5000 } && h.percentile( 0.5 ) < nanoseconds{ 10000 } )
+    DYNAMIC_ASSERT( h.percentile( 1 ) == h.max() )
+
+    thread_pool t{ 2, scheduling_policy::work_stealing };
+    DYNAMIC_ASSERT( !t.stats_enabled() )
+
+    // Nothing is recorded while disabled
+    t.add_task( [](){} ).get();
+    t.wait_until_finished();
+    DYNAMIC_ASSERT( !t.stats().key_present( pool_metric::run_time ) )
+    CHECK_THROW( t.stats().average_time( pool_metric::run_time ) )
+
+    t.enable_stats( true );
+    DYNAMIC_ASSERT( t.stats_enabled() )
+
+    const size_t tasks_number{ 20 };
+    t.add_task( [ &t, tasks_number ](){
+        for( size_t i{ 0 }; i < tasks_number; ++i )
+        {
+            t.post( [](){ std::this_thread::sleep_for( std::chrono::milliseconds{ 1 } ); } );
+        }
+    } ).get();
+    t.wait_until_finished();
+
+    auto stats = t.stats();
+    DYNAMIC_ASSERT( stats.histogram( pool_metric::run_time ).count() == tasks_number + 1 )
+    DYNAMIC_ASSERT( stats.histogram( pool_metric::queue_wait ).count() == tasks_number + 1 )
+    DYNAMIC_ASSERT( stats.average_time( pool_metric::run_time ) >= std::chrono::microseconds{ 900 } )
+    DYNAMIC_ASSERT( stats.workers().size() == 2 )
+    DYNAMIC_ASSERT( stats.total().tasks == tasks_number + 1 )
+    DYNAMIC_ASSERT( stats.total().busy_time >= std::chrono::milliseconds{ tasks_number } )
+    DYNAMIC_ASSERT( stats.utilization() > 0 && stats.utilization() <= 1 )
+
+    // Removed workers stay in the totals
+    t.schedule_remove_workers( 1 );
+    while( t.stats().workers().size() != 1 )
+    {
+        t.add_task( [](){} ).get();
+    }
+
+    DYNAMIC_ASSERT( t.stats().total().tasks > tasks_number + 1 )
+
+    t.reset_stats();
+    DYNAMIC_ASSERT( t.stats().total().tasks == 0 )
+    DYNAMIC_ASSERT( !t.stats().key_present( pool_metric::queue_wait ) )
+}
+
+TEST_CASE( thread_pool_idle_policy_test )
+{
+    CHECK_NOTHROW( cpu_relax() )
+
+    thread_pool t{ 3 };
+
+    idle_policy defaults{ t.get_idle_policy() };
+    DYNAMIC_ASSERT( defaults.spin_count == 0 && defaults.yield_count == 0 )
+
+    idle_policy spinning;
+    spinning.spin_count = 2000;
+    spinning.yield_count = 100;
+    t.set_idle_policy( spinning );
+    DYNAMIC_ASSERT( t.get_idle_policy().spin_count == 2000 && t.get_idle_policy().yield_count == 100 )
+
+    // Tasks arriving one by one are picked up by spinning or parked workers alike
+    std::atomic< int > counter{ 0 };
+    for( int i{ 0 }; i < 200; ++i )
+    {
+        t.post( [ &counter ](){ ++counter; } );
+
+        if( i % 50 == 0 )
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds{ 1 } );
+        }
+    }
+
+    t.wait_until_finished();
+    DYNAMIC_ASSERT( counter == 200 )
+
+    // Spinning workers are still removable
+    t.schedule_remove_workers( 2 );
+    while( t.workers_to_remove() )
+    {
+        std::this_thread::yield();
+    }
+
+    DYNAMIC_ASSERT( t.add_task( [](){ return 1; } ).get() == 1 )
+    DYNAMIC_ASSERT( t.workers_number() == 1 )
+
+    // Concurrent submitters facing a single spinning worker each claim it only once, the parked workers are woken
+    // for the rest. The tasks finish only once all of them run at the same time
+    thread_pool claimed{ 4 };
+    claimed.add_task( [](){} ).get();
+    std::this_thread::sleep_for( std::chrono::milliseconds{ 20 } );
+
+    idle_policy long_spin;
+    long_spin.yield_count = 100000000;
+    claimed.set_idle_policy( long_spin );
+
+    // One worker runs it and then spins, the others stay parked
+    claimed.add_task( [](){} ).get();
+
+    std::atomic< int > running{ 0 };
+    std::atomic_bool go{ false };
+    std::vector< std::future< bool > > together( 4 );
+    std::vector< std::thread > submitters;
+
+    for( size_t i{ 0 }; i < together.size(); ++i )
+    {
+        submitters.emplace_back( [ &, i ]()
+        {
+            while( !go )
+            {
+                std::this_thread::yield();
+            }
+
+            together[ i ] = claimed.add_task( [ &running ]()
+            {
+                ++running;
+
+                const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{ 2 };
+                while( running < 4 && std::chrono::steady_clock::now() < deadline )
+                {
+                    std::this_thread::yield();
+                }
+
+                return running >= 4;
+            } );
+        } );
+    }
+
+    go = true;
+    for( auto& submitter : submitters )
+    {
+        submitter.join();
+    }
+
+    for( auto& result : together )
+    {
+        DYNAMIC_ASSERT( result.get() )
+    }
+}
+
+TEST_CASE( thread_pool_cancellation_test )
+{
+    cancellation_token never;
+    DYNAMIC_ASSERT( !never.can_be_cancelled() && !never.is_cancellation_requested() )
+    CHECK_NOTHROW( never.throw_if_cancellation_requested() )
+
+    cancellation_source source;
+    cancellation_token token{ source.token() };
+    DYNAMIC_ASSERT( token.can_be_cancelled() && !token.is_cancellation_requested() )
+
+    thread_pool t{ 1 };
+
+    // A running task polls the token
+    std::atomic_bool started{ false };
+    auto running = t.add_task( [ &started ]( cancellation_token token )
+    {
+        started = true;
+
+        size_t iterations{ 0 };
+        while( !token.is_cancellation_requested() )
+        {
+            ++iterations;
+            std::this_thread::yield();
+        }
+
+        return iterations;
+    }, source.token() );
+
+    while( !started )
+    {
+        std::this_thread::yield();
+    }
+
+    // Queued behind the running one, never started
+    std::atomic< int > calls{ 0 };
+    auto queued = t.add_task( token, [ &calls ](){ return ++calls; } );
+    auto queued_high = t.add_task( task_priority::high, token, [ &calls ]( int value ){ calls += value; }, 10 );
+    t.post( token, [ &calls ](){ ++calls; } );
+    t.post( task_priority::low, token, [ &calls ](){ return ++calls; } );
+
+    // Another source's tasks are not affected
+    cancellation_source other;
+    auto unaffected = t.add_task( other.token(), [](){ return 42; } );
+
+    DYNAMIC_ASSERT( source.cancel() )
+    DYNAMIC_ASSERT( !source.cancel() )
+    DYNAMIC_ASSERT( source.is_cancellation_requested() && token.is_cancellation_requested() )
+
+    CHECK_NOTHROW( running.get() )
+    CHECK_THROW( queued.get() )
+    CHECK_THROW( queued_high.get() )
+    DYNAMIC_ASSERT( unaffected.get() == 42 )
+
+    t.wait_until_finished();
+    DYNAMIC_ASSERT( calls == 0 )
+
+    bool thrown{ false };
+    try
+    {
+        t.add_task( token, [](){} ).get();
+    }
+    catch( const task_cancelled& )
+    {
+        thrown = true;
+    }
+
+    DYNAMIC_ASSERT( thrown )
+    CHECK_THROW( token.throw_if_cancellation_requested() )
+}
+
+TEST_CASE( timer_wheel_test )
+{
+    timer_wheel< int > wheel;
+    std::vector< int > fired;
+    auto collect = [ &fired ]( int& value ){ fired.emplace_back( value ); };
+
+    DYNAMIC_ASSERT( wheel.empty() && wheel.next_event() == timer_wheel< int >::never )
+
+    // Expiries spread over several levels, including the top one
+    const uint64_t far{ uint64_t{ 1 } << 62 };
+    wheel.add( 5, 5 );
+    wheel.add( 64, 64 );
+    wheel.add( 70, 70 );
+    wheel.add( 5000, 5000 );
+    wheel.add( 300000, 300000 );
+    wheel.add( far, -1 );
+    const timer_id cancelled{ wheel.add( 100, 100 ) };
+    DYNAMIC_ASSERT( wheel.size() == 7 )
+    DYNAMIC_ASSERT( wheel.next_event() == 5 )
+
+    DYNAMIC_ASSERT( wheel.cancel( cancelled ) )
+    DYNAMIC_ASSERT( !wheel.cancel( cancelled ) )
+
+    wheel.advance( 4, collect );
+    DYNAMIC_ASSERT( fired.empty() && wheel.now() == 4 )
+
+    wheel.advance( 70, collect );
+    DYNAMIC_ASSERT( ( fired == std::vector< int >{ 5, 64, 70 } ) )
+
+    // Large jumps are made over the empty slots, timers cascade down to their exact tick
+    wheel.advance( 4999, collect );
+    DYNAMIC_ASSERT( fired.size() == 3 && wheel.now() == 4999 )
+
+    wheel.advance( 1000000, collect );
+    DYNAMIC_ASSERT( ( fired == std::vector< int >{ 5, 64, 70, 5000, 300000 } ) )
+    DYNAMIC_ASSERT( wheel.size() == 1 && wheel.next_event() <= far )
+
+    wheel.advance( far - 1, collect );
+    DYNAMIC_ASSERT( fired.size() == 5 )
+    wheel.advance( far, collect );
+    DYNAMIC_ASSERT( fired.size() == 6 && fired.back() == -1 && wheel.empty() )
+
+    // Past expiry fires at the next tick, periodic timers skip the missed periods
+    fired.clear();
+    wheel.add( 0, 1 );
+    const timer_id periodic{ wheel.add( far + 10, 2, 10 ) };
+    wheel.advance( far + 1, collect );
+    DYNAMIC_ASSERT( ( fired == std::vector< int >{ 1 } ) )
+
+    wheel.advance( far + 30, collect );
+    DYNAMIC_ASSERT( ( fired == std::vector< int >{ 1, 2 } ) && wheel.next_event() == far + 40 )
+
+    wheel.advance( far + 40, collect );
+    wheel.advance( far + 50, collect );
+    DYNAMIC_ASSERT( ( fired == std::vector< int >{ 1, 2, 2, 2 } ) )
+
+    DYNAMIC_ASSERT( wheel.cancel( periodic ) )
+    wheel.advance( far + 200, collect );
+    DYNAMIC_ASSERT( fired.size() == 4 && wheel.empty() )
+
+    // Slots are reused, stale ids don't cancel the new timers
+    const timer_id reused{ wheel.add( far + 300, 3 ) };
+    DYNAMIC_ASSERT( reused != periodic && !wheel.cancel( periodic ) )
+    DYNAMIC_ASSERT( wheel.cancel( reused ) )
+}
+
+TEST_CASE( thread_pool_timers_test )
+{
+    using namespace std::chrono;
+    using helpers::temporal::millisec_t;
+
+    thread_pool t{ 2 };
+
+    const auto start = steady_clock::now();
+    auto after = t.add_task_after( milliseconds{ 20 }, []( int value ){ return value; }, 1 );
+    auto at = t.add_task_at( start + milliseconds{ 10 }, [](){ return steady_clock::now(); } );
+    auto after_temporal = t.add_task_after( millisec_t{ 15 }, [](){ return 3; } );
+    auto at_temporal = t.add_task_at( millisec_t::now() + millisec_t{ 5 }, [](){ return 4; } );
+
+    DYNAMIC_ASSERT( after.get() == 1 )
+    DYNAMIC_ASSERT( steady_clock::now() - start >= milliseconds{ 20 } )
+    DYNAMIC_ASSERT( at.get() - start >= milliseconds{ 10 } )
+    DYNAMIC_ASSERT( after_temporal.get() == 3 )
+    DYNAMIC_ASSERT( at_temporal.get() == 4 )
+
+    // Cancelled before firing
+    std::atomic< int > cancelled_calls{ 0 };
+    const timer_id cancelled{ t.post_after( seconds{ 10 }, [ &cancelled_calls ](){ ++cancelled_calls; } ) };
+    DYNAMIC_ASSERT( t.timers_number() == 1 )
+    DYNAMIC_ASSERT( t.cancel_timer( cancelled ) )
+    DYNAMIC_ASSERT( !t.cancel_timer( cancelled ) )
+    DYNAMIC_ASSERT( t.timers_number() == 0 )
+
+    // Periodic runs never overlap
+    std::atomic< int > runs{ 0 };
+    std::atomic< int > running{ 0 };
+    std::atomic_bool overlapped{ false };
+    const timer_id periodic{ t.add_periodic_task( millisec_t{ 1 }, [ & ]()
+    {
+        if( ++running > 1 )
+        {
+            overlapped = true;
+        }
+
+        std::this_thread::sleep_for( milliseconds{ 3 } );
+        --running;
+        ++runs;
+    } ) };
+
+    while( runs < 5 )
+    {
+        std::this_thread::sleep_for( milliseconds{ 1 } );
+    }
+
+    DYNAMIC_ASSERT( t.cancel_timer( periodic ) )
+    t.wait_until_finished();
+
+    const int total_runs{ runs };
+    std::this_thread::sleep_for( milliseconds{ 10 } );
+    DYNAMIC_ASSERT( runs == total_runs && !overlapped )
+
+    CHECK_THROW( t.add_periodic_task( microseconds{ 10 }, [](){} ) )
+
+    // Many pending timers, dropped along with the pool
+    {
+        thread_pool p{ 1 };
+        std::vector< std::future< void > > dropped;
+
+        for( int i{ 0 }; i < 10000; ++i )
+        {
+            dropped.emplace_back( p.add_task_after( seconds{ 60 + i }, [](){} ) );
+        }
+
+        DYNAMIC_ASSERT( p.timers_number() == 10000 )
+        p.post_after( milliseconds{ 1 }, [ &cancelled_calls ](){ ++cancelled_calls; } );
+
+        while( !cancelled_calls )
+        {
+            std::this_thread::sleep_for( milliseconds{ 1 } );
+        }
+
+        DYNAMIC_ASSERT( p.timers_number() == 10000 )
+    }
+
+    DYNAMIC_ASSERT( cancelled_calls == 1 )
+}
+
+#ifdef HELPERS_HAS_COROUTINES
+task< int > coroutine_add( thread_pool& pool, int l, int r )
+{
+    co_await pool.schedule();
+    co_return l + r;
+}
+
+task< int > coroutine_pipeline( thread_pool& pool, std::thread::id& worker )
+{
+    co_await pool.schedule();
+    worker = std::this_thread::get_id();
+
+    int sum{ co_await coroutine_add( pool, 1, 2 ) };
+    sum += co_await coroutine_add( pool, 3, 4 );
+
+    co_await pool.schedule_after( std::chrono::milliseconds{ 2 } );
+    co_return sum;
+}
+
+task<> coroutine_throw( thread_pool& pool )
+{
+    co_await pool.schedule( task_priority::high );
+    throw std::runtime_error{ "failed" };
+}
+
+task< bool > coroutine_await_empty()
+{
+    try
+    {
+        co_await task< int >{};
+    }
+    catch( const std::future_error& e )
+    {
+        co_return e.code() == std::future_errc::no_state;
+    }
+
+    co_return false;
+}
+
+TEST_CASE( coroutine_task_test )
+{
+    // Awaiting tasks doesn't block the only worker
+    thread_pool single{ 1 };
+    std::thread::id worker;
+
+    DYNAMIC_ASSERT( spawn( single, coroutine_pipeline( single, worker ) ).get() == 10 )
+    DYNAMIC_ASSERT( worker != std::thread::id{} && worker != std::this_thread::get_id() )
+
+    thread_pool t{ 3 };
+    std::vector< std::future< int > > results;
+
+    for( int i{ 0 }; i < 100; ++i )
+    {
+        results.emplace_back( spawn( t, coroutine_add( t, i, i ) ) );
+    }
+
+    for( int i{ 0 }; i < 100; ++i )
+    {
+        DYNAMIC_ASSERT( results[ i ].get() == 2 * i )
+    }
+
+    CHECK_THROW( spawn( t, coroutine_throw( t ) ).get() )
+    DYNAMIC_ASSERT( spawn( t, coroutine_await_empty() ).get() )
+
+    task< int > empty;
+    DYNAMIC_ASSERT( !empty.valid() && !empty.is_ready() )
+
+    // A coroutine dropped by the pool is resumed with an exception
+    std::promise< void > gate;
+    std::shared_future< void > opened{ gate.get_future() };
+    single.post( [ opened ](){ opened.wait(); } );
+
+    auto dropped = spawn( single, coroutine_add( single, 1, 1 ) );
+    single.clean_pending_tasks();
+    gate.set_value();
+
+    bool broken{ false };
+    try
+    {
+        dropped.get();
+    }
+    catch( const std::future_error& e )
+    {
+        broken = e.code() == std::future_errc::broken_promise;
+    }
+
+    DYNAMIC_ASSERT( broken )
+
+    // A resumer run or dropped by the queue limit inside the post resumes the coroutine in the calling thread
+    {
+        thread_pool limited{ 1 };
+        std::promise< void > started;
+        std::promise< void > release;
+        std::shared_future< void > released{ release.get_future() };
+        limited.post( [ & ](){ started.set_value(); released.wait(); } );
+        started.get_future().wait();
+
+        queue_limit limit;
+        limit.capacity = 1;
+        limit.policy = overflow_policy::caller_runs;
+        limited.set_queue_limit( limit );
+        limited.post( [](){} );
+
+        auto inline_result = spawn( limited, coroutine_add( limited, 2, 3 ) );
+        DYNAMIC_ASSERT( inline_result.wait_for( std::chrono::seconds{ 0 } ) == std::future_status::ready )
+        DYNAMIC_ASSERT( inline_result.get() == 5 )
+
+        limit.policy = overflow_policy::reject;
+        limited.set_queue_limit( limit );
+
+        auto rejected = spawn( limited, coroutine_add( limited, 2, 3 ) );
+        DYNAMIC_ASSERT( rejected.wait_for( std::chrono::seconds{ 0 } ) == std::future_status::ready )
+
+        bool rejected_broken{ false };
+        try
+        {
+            rejected.get();
+        }
+        catch( const std::future_error& e )
+        {
+            rejected_broken = e.code() == std::future_errc::broken_promise;
+        }
+
+        DYNAMIC_ASSERT( rejected_broken )
+        release.set_value();
+        limited.wait_until_finished();
+    }
+}
+#endif
+
+TEST_CASE( task_group_test )
+{
+    thread_pool t{ 2 };
+
+    // A task of the pool outside the group is not waited for
+    std::promise< void > gate;
+    std::shared_future< void > opened{ gate.get_future() };
+    t.post( [ opened ](){ opened.wait(); } );
+
+    {
+        task_group group{ t };
+        std::atomic< int > counter{ 0 };
+        std::vector< std::future< int > > results;
+
+        for( int i{ 0 }; i < 50; ++i )
+        {
+            results.emplace_back( group.add_task( [ &counter ]( int value ){ ++counter; return value; }, i ) );
+            group.post( [ &counter ](){ ++counter; throw std::runtime_error{ "ignored" }; } );
+        }
+
+        group.wait();
+        DYNAMIC_ASSERT( counter == 100 && group.size() == 0 )
+
+        for( int i{ 0 }; i < 50; ++i )
+        {
+            DYNAMIC_ASSERT( results[ i ].get() == i )
+        }
+
+        DYNAMIC_ASSERT( t.total_tasks_number() >= 1 )
+    }
+
+    // The waiter runs the group's tasks while the pool is busy
+    thread_pool single{ 1 };
+    single.post( [ opened ](){ opened.wait(); } );
+
+    {
+        task_group group{ single };
+        std::thread::id runner;
+        group.post( [ &runner ](){ runner = std::this_thread::get_id(); } );
+
+        DYNAMIC_ASSERT( group.wait_for( std::chrono::seconds{ 5 } ) )
+        DYNAMIC_ASSERT( runner == std::this_thread::get_id() )
+
+        // A task started by the pool's worker before the wait
+        std::promise< void > slow_gate;
+        std::shared_future< void > slow_opened{ slow_gate.get_future() };
+        std::atomic_bool started{ false };
+        task_group slow{ t };
+        slow.post( [ slow_opened, &started ](){ started = true; slow_opened.wait(); } );
+
+        while( !started )
+        {
+            std::this_thread::yield();
+        }
+
+        DYNAMIC_ASSERT( !slow.wait_for( std::chrono::milliseconds{ 20 } ) )
+        DYNAMIC_ASSERT( slow.size() == 1 )
+
+        slow_gate.set_value();
+        DYNAMIC_ASSERT( slow.wait_for( std::chrono::seconds{ 5 } ) )
+    }
+
+    // Nested groups waited for inside the only worker
+    std::atomic< int > nested{ 0 };
+    task_group outer{ t };
+    outer.post( [ &nested, &t ]()
+    {
+        task_group inner{ t };
+
+        for( int i{ 0 }; i < 10; ++i )
+        {
+            inner.post( [ &nested ](){ ++nested; } );
+        }
+
+        inner.wait();
+        ++nested;
+    } );
+
+    gate.set_value();
+    outer.wait();
+    DYNAMIC_ASSERT( nested == 11 )
+}
+
+TEST_CASE( thread_pool_wait_test )
+{
+    thread_pool t{ 2 };
+
+    // Nothing to wait for, returns without locking
+    DYNAMIC_ASSERT( t.wait_until_finished( std::chrono::milliseconds{ 1 } ) )
+
+    std::atomic< int > counter{ 0 };
+    for( int i{ 0 }; i < 1000; ++i )
+    {
+        t.post( [ &counter ](){ ++counter; } );
+    }
+
+    // Several waiters at once
+    std::vector< std::thread > waiters;
+    std::atomic< int > woken{ 0 };
+    for( int i{ 0 }; i < 3; ++i )
+    {
+        waiters.emplace_back( [ &t, &woken ](){ t.wait_until_finished(); ++woken; } );
+    }
+
+    t.wait_until_finished();
+    DYNAMIC_ASSERT( counter == 1000 )
+
+    for( auto& waiter : waiters )
+    {
+        waiter.join();
+    }
+
+    DYNAMIC_ASSERT( woken == 3 && t.total_tasks_number() == 0 )
+
+    // Waiters are woken when the last tasks are dropped rather than finished
+    std::promise< void > gate;
+    std::shared_future< void > opened{ gate.get_future() };
+    for( int i{ 0 }; i < 2; ++i )
+    {
+        t.post( [ opened ](){ opened.wait(); } );
+    }
+
+    for( int i{ 0 }; i < 10; ++i )
+    {
+        t.post( [ &counter ](){ ++counter; } );
+    }
+
+    std::thread waiter{ [ &t, &woken ](){ t.wait_until_finished(); ++woken; } };
+
+    DYNAMIC_ASSERT( !t.wait_until_finished( std::chrono::milliseconds{ 10 } ) )
+    gate.set_value();
+    t.clean_pending_tasks();
+
+    waiter.join();
+    DYNAMIC_ASSERT( woken == 4 && t.total_tasks_number() == 0 )
+}
+
+TEST_CASE( thread_pool_queue_limit_test )
+{
+    thread_pool t{ 1 };
+
+    DYNAMIC_ASSERT( t.get_queue_limit().capacity == 0 )
+
+    // The only worker is held by a task, so that the queue isn't drained
+    std::promise< void > started;
+    std::promise< void > gate;
+    std::shared_future< void > opened{ gate.get_future() };
+    t.post( [ & ](){ started.set_value(); opened.wait(); } );
+    started.get_future().wait();
+
+    queue_limit limit;
+    limit.capacity = 2;
+    limit.policy = overflow_policy::reject;
+    t.set_queue_limit( limit );
+
+    DYNAMIC_ASSERT( t.get_queue_limit().capacity == 2 && t.get_queue_limit().policy == overflow_policy::reject )
+
+    auto first = t.add_task( [](){ return 1; } );
+    auto second = t.add_task( [](){ return 2; } );
+    auto rejected = t.add_task( [](){ return 3; } );
+    t.post( [](){} );
+
+    DYNAMIC_ASSERT( t.queue_size() == 2 )
+    CHECK_THROW( rejected.get() )
+    DYNAMIC_ASSERT( t.overflow_counters().rejected == 2 )
+
+    // A batch is admitted up to the capacity, the rest get queue_full
+    t.clean_pending_tasks();
+    std::vector< std::function< int() > > batch( 3, [](){ return 0; } );
+    auto batch_results = t.add_tasks( batch.begin(), batch.end() );
+
+    DYNAMIC_ASSERT( t.queue_size() == 2 && t.overflow_counters().rejected == 3 )
+
+    bool batch_rejected{ false };
+    try
+    {
+        batch_results[ 2 ].get();
+    }
+    catch( const queue_full& )
+    {
+        batch_rejected = true;
+    }
+
+    DYNAMIC_ASSERT( batch_rejected )
+
+    // Caller runs
+    limit.policy = overflow_policy::caller_runs;
+    t.set_queue_limit( limit );
+
+    const auto caller = std::this_thread::get_id();
+    auto inline_run = t.add_task( [ caller ](){ return std::this_thread::get_id() == caller; } );
+
+    DYNAMIC_ASSERT( inline_run.get() && t.overflow_counters().caller_runs == 1 )
+
+    // Drop oldest, low priority tasks go first
+    limit.policy = overflow_policy::drop_oldest;
+    t.set_queue_limit( limit );
+    t.clean_pending_tasks();
+
+    auto low = t.add_task( task_priority::low, [](){ return 1; } );
+    auto oldest = t.add_task( [](){ return 2; } );
+    auto newest = t.add_task( [](){ return 3; } );
+
+    DYNAMIC_ASSERT( t.queue_size() == 2 && t.overflow_counters().dropped == 1 )
+    CHECK_THROW( low.get() )
+
+    // Block with a timeout
+    limit.policy = overflow_policy::block;
+    limit.block_timeout = std::chrono::milliseconds{ 20 };
+    t.set_queue_limit( limit );
+
+    auto timed_out = t.add_task( [](){ return 4; } );
+    CHECK_THROW( timed_out.get() )
+    DYNAMIC_ASSERT( t.overflow_counters().blocked == 1 && t.overflow_counters().timed_out == 1 )
+
+    // Block until the worker makes room
+    limit.block_timeout = std::chrono::milliseconds{ 0 };
+    t.set_queue_limit( limit );
+
+    std::future< int > blocked;
+    std::thread submitter{ [ & ](){ blocked = t.add_task( [](){ return 5; } ); } };
+
+    while( t.overflow_counters().blocked != 2 )
+    {
+        std::this_thread::yield();
+    }
+
+    gate.set_value();
+    submitter.join();
+
+    DYNAMIC_ASSERT( oldest.get() == 2 && newest.get() == 3 && blocked.get() == 5 )
+
+    // A worker isn't blocked, it runs the task itself
+    limit.capacity = 1;
+    t.set_queue_limit( limit );
+
+    auto nested = t.add_task( [ &t ]()
+    {
+        auto queued = t.add_task( [](){ return 1; } );
+        auto run_inline = t.add_task( [](){ return 2; } );
+
+        return run_inline.wait_for( std::chrono::seconds{ 0 } ) == std::future_status::ready;
+    } );
+
+    DYNAMIC_ASSERT( nested.get() && t.overflow_counters().caller_runs == 2 )
+
+    t.set_queue_limit( queue_limit{} );
+    t.wait_until_finished();
+}
+
+TEST_CASE( thread_pool_keyed_test )
+{
+    thread_pool t{ 4 };
+
+    DYNAMIC_ASSERT( t.keyed_steal_delay() == std::chrono::milliseconds{ 1 } )
+
+    // Tasks of a key run on the same worker, as long as they aren't held up long enough to be stolen
+    t.set_keyed_steal_delay( std::chrono::seconds{ 10 } );
+
+    auto same_worker = [ &t ]( int key )
+    {
+        std::vector< std::future< std::thread::id > > runs;
+        for( int i{ 0 }; i < 50; ++i )
+        {
+            runs.emplace_back( t.add_task_keyed( key, [](){ return std::this_thread::get_id(); } ) );
+        }
+
+        const auto id = runs.front().get();
+        bool same{ true };
+        for( size_t i{ 1 }; i < runs.size(); ++i )
+        {
+            same = runs[ i ].get() == id && same;
+        }
+
+        return same;
+    };
+
+    for( int key{ 0 }; key < 8; ++key )
+    {
+        DYNAMIC_ASSERT( same_worker( key ) )
+    }
+
+    DYNAMIC_ASSERT( t.add_task_keyed( std::string{ "shard" }, []( int value ){ return value; }, 7 ).get() == 7 )
+
+    // Removing a worker moves only its own keys, the keys of the rest keep their workers
+    auto key_workers = [ &t ]()
+    {
+        std::vector< std::future< std::thread::id > > runs;
+        for( int key{ 0 }; key < 64; ++key )
+        {
+            runs.emplace_back( t.add_task_keyed( key, [](){ return std::this_thread::get_id(); } ) );
+        }
+
+        std::vector< std::thread::id > workers;
+        for( auto& run : runs )
+        {
+            workers.emplace_back( run.get() );
+        }
+
+        return workers;
+    };
+
+    const auto before_removal = key_workers();
+    t.schedule_remove_workers( 1 );
+
+    while( t.workers_to_remove() )
+    {
+        std::this_thread::yield();
+    }
+
+    const auto after_removal = key_workers();
+    std::thread::id removed;
+    size_t moved{ 0 };
+    bool kept{ true };
+
+    for( size_t key{ 0 }; key < before_removal.size(); ++key )
+    {
+        if( before_removal[ key ] != after_removal[ key ] )
+        {
+            if( removed == std::thread::id{} )
+            {
+                removed = before_removal[ key ];
+            }
+
+            kept = before_removal[ key ] == removed && kept;
+            ++moved;
+        }
+    }
+
+    DYNAMIC_ASSERT( kept && moved > 0 )
+    DYNAMIC_ASSERT( std::find( after_removal.begin(), after_removal.end(), removed ) == after_removal.end() )
+    t.add_workers( 1 );
+
+    // A held up keyed task is stolen once it has waited for the delay
+    t.set_keyed_steal_delay( std::chrono::milliseconds{ 1 } );
+
+    std::promise< void > gate;
+    std::shared_future< void > opened{ gate.get_future() };
+    auto holder = t.add_task_keyed( 1, [ opened ](){ opened.wait(); return std::this_thread::get_id(); } );
+    auto stolen = t.add_task_keyed( 1, [](){ return std::this_thread::get_id(); } );
+
+    DYNAMIC_ASSERT( stolen.wait_for( std::chrono::seconds{ 5 } ) == std::future_status::ready )
+    gate.set_value();
+    DYNAMIC_ASSERT( holder.get() != stolen.get() )
+
+    // An idle worker waiting with a long delay picks up a shorter one right away
+    {
+        thread_pool pair{ 2 };
+        pair.set_keyed_steal_delay( std::chrono::seconds{ 10 } );
+
+        std::promise< void > held;
+        std::promise< void > release;
+        std::shared_future< void > released{ release.get_future() };
+        auto pair_holder = pair.add_task_keyed( 1, [ &held, released ](){ held.set_value(); released.wait(); } );
+        held.get_future().wait();
+
+        auto waiting = pair.add_task_keyed( 1, [](){} );
+
+        // Lets the idle worker park with the 10 seconds delay
+        std::this_thread::sleep_for( std::chrono::milliseconds{ 20 } );
+        pair.set_keyed_steal_delay( std::chrono::milliseconds{ 1 } );
+
+        DYNAMIC_ASSERT( waiting.wait_for( std::chrono::seconds{ 2 } ) == std::future_status::ready )
+        release.set_value();
+        pair_holder.get();
+    }
+
+    // The delay counts from when the keyed task was added, not from when an idle worker parks
+    {
+        thread_pool pair{ 2 };
+        const std::chrono::milliseconds delay{ 200 };
+        pair.set_keyed_steal_delay( delay );
+
+        std::promise< void > held;
+        std::promise< void > release;
+        std::shared_future< void > released{ release.get_future() };
+        auto pair_holder = pair.add_task_keyed( 1, [ &held, released ](){ held.set_value(); released.wait(); } );
+        held.get_future().wait();
+
+        // The other worker parks only 150 milliseconds after the task is added
+        std::promise< void > busy;
+        pair.post( [ &busy ](){ busy.set_value(); std::this_thread::sleep_for( std::chrono::milliseconds{ 150 } ); } );
+        busy.get_future().wait();
+
+        const auto added = std::chrono::steady_clock::now();
+        auto delayed = pair.add_task_keyed( 1, [](){ return std::chrono::steady_clock::now(); } );
+        const auto waited = delayed.get() - added;
+
+        DYNAMIC_ASSERT( waited >= delay && waited < delay + std::chrono::milliseconds{ 100 } )
+        release.set_value();
+        pair_holder.get();
+    }
+
+    // Keyed tasks keep running while the pool is resized
+    std::atomic< int > counter{ 0 };
+    t.add_workers( 2 );
+
+    for( int i{ 0 }; i < 600; ++i )
+    {
+        t.add_task_keyed( i % 16, [ &counter ](){ ++counter; } );
+
+        if( i == 200 )
+        {
+            t.schedule_remove_workers( 5 );
+        }
+    }
+
+    t.wait_until_finished();
+    DYNAMIC_ASSERT( counter == 600 && t.queue_size() == 0 )
+    DYNAMIC_ASSERT( same_worker( 3 ) )
+}
+
+TEST_CASE( strand_test )
+{
+    thread_pool t{ 3 };
+
+    CHECK_THROW( ( strand{ t, 0 } ) )
+
+    // Tasks of a strand run one at a time and in order
+    std::array< std::unique_ptr< strand >, 4 > strands;
+    std::array< std::vector< int >, 4 > orders;
+    std::array< std::atomic< int >, 4 > running{};
+    std::atomic_bool overlapped{ false };
+
+    for( size_t s{ 0 }; s < strands.size(); ++s )
+    {
+        strands[ s ].reset( new strand{ t, 16 } );
+    }
+
+    for( int i{ 0 }; i < 1000; ++i )
+    {
+        for( size_t s{ 0 }; s < strands.size(); ++s )
+        {
+            strands[ s ]->post( [ &, s, i ]()
+            {
+                if( ++running[ s ] != 1 || !strands[ s ]->running_in_this_thread() )
+                {
+                    overlapped = true;
+                }
+
+                orders[ s ].emplace_back( i );
+                --running[ s ];
+            } );
+        }
+    }
+
+    t.wait_until_finished();
+    DYNAMIC_ASSERT( !overlapped )
+
+    for( const auto& order : orders )
+    {
+        bool ordered{ order.size() == 1000 };
+        for( int i{ 0 }; ordered && i < 1000; ++i )
+        {
+            ordered = order[ i ] == i;
+        }
+
+        DYNAMIC_ASSERT( ordered )
+    }
+
+    DYNAMIC_ASSERT( !strands[ 0 ]->running_in_this_thread() )
+
+    // Different strands run in parallel
+    strand first{ t };
+    strand second{ t };
+    std::atomic< int > arrived{ 0 };
+    auto meet = [ &arrived ]()
+    {
+        ++arrived;
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{ 5 };
+        while( arrived < 2 && std::chrono::steady_clock::now() < deadline )
+        {
+            std::this_thread::yield();
+        }
+
+        return arrived == 2;
+    };
+
+    auto met_first = first.add_task( meet );
+    auto met_second = second.add_task( meet );
+    DYNAMIC_ASSERT( met_first.get() && met_second.get() )
+
+    // Tasks dropped from the pool, the strand keeps working afterwards
+    thread_pool single{ 1 };
+    std::promise< void > gate;
+    std::shared_future< void > opened{ gate.get_future() };
+    single.post( [ opened ](){ opened.wait(); } );
+
+    strand dropped{ single };
+    auto lost = dropped.add_task( [](){ return 1; } );
+    dropped.post( [](){} );
+    DYNAMIC_ASSERT( dropped.size() == 2 )
+
+    single.clean_pending_tasks();
+    gate.set_value();
+
+    CHECK_THROW( lost.get() )
+    DYNAMIC_ASSERT( dropped.size() == 0 )
+    DYNAMIC_ASSERT( dropped.add_task( [](){ return 2; } ).get() == 2 )
+}
+
+TEST_CASE( parallel_algorithms_test )
+{
+    thread_pool t{ 3 };
+
+    std::array< chunking_policy, 3 > policies{ chunking_policy::static_chunks,
+                                               chunking_policy::dynamic_chunks,
+                                               chunking_policy::guided_chunks };
+
+    std::vector< int > values( 1000 );
+    for( size_t i{ 0 }; i < values.size(); ++i )
+    {
+        values[ i ] = static_cast< int >( i );
+    }
+
+    for( auto policy : policies )
+    {
+        std::vector< std::atomic< int > > hits( values.size() );
+        for( auto& h : hits )
+        {
+            h = 0;
+        }
+
+        CHECK_NOTHROW( parallel_for( t, 0, 1000, [ &hits ]( int i ){ ++hits[ i ]; }, policy ) )
+        DYNAMIC_ASSERT( std::all_of( hits.begin(), hits.end(), []( const std::atomic< int >& h ){ return h == 1; } ) )
+
+        std::atomic< long > sum{ 0 };
+        CHECK_NOTHROW( parallel_for( t, values.begin(), values.end(), [ &sum ]( int v ){ sum += v; }, policy, 16 ) )
+        DYNAMIC_ASSERT( sum == 499500 )
+
+        long reduced{ 0 };
+        CHECK_NOTHROW( reduced = parallel_reduce( t, 1, 101, 0L, []( int i ){ return long{ i }; }, std::plus< long >{}, policy ) )
+        DYNAMIC_ASSERT( reduced == 5050 )
+
+        CHECK_NOTHROW( reduced = parallel_reduce( t, values.begin(), values.end(), 1L, std::plus< long >{}, policy ) )
+        DYNAMIC_ASSERT( reduced == 499501 )
+
+        std::vector< int > doubled( values.size() );
+        auto end = parallel_transform( t, values.begin(), values.end(), doubled.begin(), []( int v ){ return v * 2; }, policy );
+        DYNAMIC_ASSERT( end == doubled.end() )
+        DYNAMIC_ASSERT( doubled[ 999 ] == 1998 && doubled[ 1 ] == 2 )
+
+        std::vector< int > squares( 10 );
+        parallel_transform( t, 0, 10, squares.begin(), []( int i ){ return i * i; }, policy );
+        DYNAMIC_ASSERT( squares[ 9 ] == 81 )
+    }
+
+    // Empty ranges
+    DYNAMIC_ASSERT( parallel_reduce( t, 5, 5, 7, []( int i ){ return i; }, std::plus< int >{} ) == 7 )
+    CHECK_NOTHROW( parallel_for( t, 10, 0, []( int ){ throw std::runtime_error{ "" }; } ) )
+
+    // Exceptions are rethrown in the calling thread
+    CHECK_THROW( parallel_for( t, 0, 100, []( int i ){ if( i == 50 ) throw std::runtime_error{ "" }; },
+                               chunking_policy::dynamic_chunks, 1 ) )
+
+    // Nested call from a worker joins the work instead of blocking the pool
+    thread_pool single{ 1 };
+    auto nested = single.add_task( [ &single ]()
+    {
+        return parallel_reduce( single, 0, 100, 0, []( int i ){ return i; }, std::plus< int >{} );
+    } );
+
+    DYNAMIC_ASSERT( nested.wait_for( std::chrono::seconds{ 5 } ) == std::future_status::ready )
+    DYNAMIC_ASSERT( nested.get() == 4950 )
+}
+
+TEST_CASE( unique_task_test )
+{
+    struct move_only_func
+    {
+        std::unique_ptr< int > value;
+        int operator()() const { return *value; }
+    };
+
+    struct big_func
+    {
+        std::array< char, unique_task::inline_capacity * 2 > data;
+        int* calls;
+        void operator()() const { ++*calls; }
+    };
+
+    int calls{ 0 };
+
+    unique_task empty;
+    DYNAMIC_ASSERT( !empty )
+    CHECK_THROW( empty() )
+
+    unique_task small{ [ &calls ](){ ++calls; } };
+    unique_task big{ big_func{ {}, &calls } };
+    DYNAMIC_ASSERT( small && big )
+
+    unique_task moved{ std::move( small ) };
+    DYNAMIC_ASSERT( !small && moved )
+    CHECK_NOTHROW( moved() )
+
+    moved = std::move( big );
+    DYNAMIC_ASSERT( !big && moved )
+    CHECK_NOTHROW( moved() )
+    DYNAMIC_ASSERT( calls == 2 )
+
+    moved = nullptr;
+    DYNAMIC_ASSERT( !moved )
+
+    // Move-only callables and exceptions through the pool
+    thread_pool t{ 1 };
+    auto value = t.add_task( move_only_func{ std::unique_ptr< int >{ new int{ 42 } } } );
+    auto error = t.add_task( [](){ throw std::runtime_error{ "" }; } );
+
+    DYNAMIC_ASSERT( value.get() == 42 )
+    CHECK_THROW( error.get() )
+}
+
 TEST_CASE( atomic_locks_test )
 {
     using namespace std::chrono;
@@ -187,6 +1982,316 @@ TEST_CASE( atomic_locks_test )
     }
 }
 
+TEST_CASE( backoff_spinlock_test )
+{
+    backoff_spinlock<> lock;
+
+    DYNAMIC_ASSERT( lock.try_lock() )
+    DYNAMIC_ASSERT( !lock.try_lock() )
+    lock.unlock();
+
+    // Mutual exclusion under contention, including the yielding phase of a short backoff
+    auto contend = []( size_t threads_number, std::function< void( size_t& ) > increment )
+    {
+        size_t counter{ 0 };
+        std::vector< std::thread > threads;
+
+        for( size_t i{ 0 }; i < threads_number; ++i )
+        {
+            threads.emplace_back( [ & ]()
+            {
+                for( int j{ 0 }; j < 20000; ++j )
+                {
+                    increment( counter );
+                }
+            } );
+        }
+
+        for( auto& thread : threads )
+        {
+            thread.join();
+        }
+
+        return counter;
+    };
+
+    DYNAMIC_ASSERT( contend( 4, [ &lock ]( size_t& counter ){ std::lock_guard< backoff_spinlock<> > g{ lock }; ++counter; } ) == 80000 )
+
+    backoff_spinlock< 1, 2 > short_backoff;
+    DYNAMIC_ASSERT( contend( 4, [ &short_backoff ]( size_t& counter ){ std::lock_guard< backoff_spinlock< 1, 2 > > g{ short_backoff }; ++counter; } ) == 80000 )
+
+    // Held lock is waited for
+    lock.lock();
+    std::atomic_bool acquired{ false };
+    std::thread waiter{ [ & ](){ lock.lock(); acquired = true; lock.unlock(); } };
+
+    std::this_thread::sleep_for( std::chrono::milliseconds{ 20 } );
+    DYNAMIC_ASSERT( !acquired )
+    lock.unlock();
+    waiter.join();
+    DYNAMIC_ASSERT( acquired )
+}
+
+TEST_CASE( fair_rw_spinlock_test )
+{
+    fair_rw_spinlock lock;
+
+    lock.lock( lock_mode::read );
+    DYNAMIC_ASSERT( lock.try_lock( lock_mode::read ) )
+    DYNAMIC_ASSERT( !lock.try_lock( lock_mode::write ) )
+    lock.unlock( lock_mode::read );
+    lock.unlock( lock_mode::read );
+
+    DYNAMIC_ASSERT( lock.try_lock( lock_mode::write ) )
+    DYNAMIC_ASSERT( !lock.try_lock( lock_mode::read ) && !lock.try_lock( lock_mode::write ) )
+    lock.unlock( lock_mode::write );
+
+    // Writers exclude everyone, readers see consistent data
+    {
+        size_t first{ 0 };
+        size_t second{ 0 };
+        std::atomic_bool stop{ false };
+        std::atomic_bool torn{ false };
+        std::vector< std::thread > threads;
+
+        for( int i{ 0 }; i < 3; ++i )
+        {
+            threads.emplace_back( [ & ]()
+            {
+                while( !stop )
+                {
+                    fair_rw_spinlock_guard g{ lock, lock_mode::read };
+
+                    if( first != second )
+                    {
+                        torn = true;
+                    }
+                }
+            } );
+        }
+
+        std::vector< std::thread > writers;
+        for( int i{ 0 }; i < 2; ++i )
+        {
+            writers.emplace_back( [ & ]()
+            {
+                for( int j{ 0 }; j < 10000; ++j )
+                {
+                    fair_rw_spinlock_guard g{ lock, lock_mode::write };
+                    ++first;
+                    ++second;
+                }
+            } );
+        }
+
+        // Writers get through a continuous stream of readers
+        for( auto& writer : writers )
+        {
+            writer.join();
+        }
+
+        stop = true;
+        for( auto& thread : threads )
+        {
+            thread.join();
+        }
+
+        DYNAMIC_ASSERT( !torn && first == 20000 && second == 20000 )
+    }
+
+    // Phase fairness: a reader that arrived while a writer was active goes ahead of the next waiting writer
+    {
+        std::atomic_bool second_writer_in{ false };
+        std::atomic_bool overtaken{ false };
+
+        lock.lock( lock_mode::write );
+
+        std::thread reader{ [ & ]()
+        {
+            fair_rw_spinlock_guard g{ lock, lock_mode::read };
+            std::this_thread::sleep_for( std::chrono::milliseconds{ 50 } );
+            overtaken = second_writer_in.load();
+        } };
+
+        std::this_thread::sleep_for( std::chrono::milliseconds{ 20 } );
+
+        std::thread writer{ [ & ]()
+        {
+            fair_rw_spinlock_guard g{ lock, lock_mode::write };
+            second_writer_in = true;
+        } };
+
+        std::this_thread::sleep_for( std::chrono::milliseconds{ 20 } );
+        lock.unlock( lock_mode::write );
+
+        reader.join();
+        writer.join();
+        DYNAMIC_ASSERT( !overtaken && second_writer_in )
+    }
+}
+
+TEST_CASE( br_spinlock_test )
+{
+    br_spinlock lock{ 3 };
+
+    DYNAMIC_ASSERT( lock.slots() == 4 && br_spinlock{ 0 }.slots() == 1 )
+
+    lock.lock( lock_mode::read );
+    DYNAMIC_ASSERT( lock.try_lock( lock_mode::read ) )
+    DYNAMIC_ASSERT( !lock.try_lock( lock_mode::write ) )
+    lock.unlock( lock_mode::read );
+    lock.unlock( lock_mode::read );
+
+    DYNAMIC_ASSERT( lock.try_lock( lock_mode::write ) )
+    DYNAMIC_ASSERT( !lock.try_lock( lock_mode::read ) && !lock.try_lock( lock_mode::write ) )
+    lock.unlock( lock_mode::write );
+
+    // A reader of another slot blocks the writer
+    {
+        std::promise< void > locked;
+        std::promise< void > release;
+        std::thread reader{ [ & ]()
+        {
+            br_spinlock_guard g{ lock, lock_mode::read };
+            locked.set_value();
+            release.get_future().wait();
+        } };
+
+        locked.get_future().wait();
+        DYNAMIC_ASSERT( !lock.try_lock( lock_mode::write ) )
+        release.set_value();
+        reader.join();
+        DYNAMIC_ASSERT( lock.try_lock( lock_mode::write ) )
+        lock.unlock( lock_mode::write );
+    }
+
+    // More threads than slots, writers exclude everyone, readers see consistent data
+    size_t first{ 0 };
+    size_t second{ 0 };
+    std::atomic_bool stop{ false };
+    std::atomic_bool torn{ false };
+    std::vector< std::thread > readers;
+
+    for( int i{ 0 }; i < 6; ++i )
+    {
+        readers.emplace_back( [ & ]()
+        {
+            while( !stop )
+            {
+                br_spinlock_guard g{ lock, lock_mode::read };
+
+                if( first != second )
+                {
+                    torn = true;
+                }
+            }
+        } );
+    }
+
+    std::vector< std::thread > writers;
+    for( int i{ 0 }; i < 2; ++i )
+    {
+        writers.emplace_back( [ & ]()
+        {
+            for( int j{ 0 }; j < 5000; ++j )
+            {
+                br_spinlock_guard g{ lock, lock_mode::write };
+                ++first;
+                ++second;
+            }
+        } );
+    }
+
+    for( auto& writer : writers )
+    {
+        writer.join();
+    }
+
+    stop = true;
+    for( auto& reader : readers )
+    {
+        reader.join();
+    }
+
+    DYNAMIC_ASSERT( !torn && first == 10000 && second == 10000 )
+}
+
+TEST_CASE( seqlock_test )
+{
+    struct point
+    {
+        uint64_t x;
+        uint64_t y;
+        uint32_t z;
+    };
+
+    seqlock< point > value{ point{ 1, 1, 1 } };
+
+    point p{ value.load() };
+    DYNAMIC_ASSERT( p.x == 1 && p.y == 1 && p.z == 1 )
+
+    value.store( point{ 2, 3, 4 } );
+    DYNAMIC_ASSERT( value.try_load( p ) && p.x == 2 && p.y == 3 && p.z == 4 )
+
+    // A throwing update leaves the value as it was and doesn't keep the writer side
+    CHECK_THROW( value.update( []( point& v ){ v.x = 0; throw std::runtime_error{ "update" }; } ) )
+    p = value.load();
+    DYNAMIC_ASSERT( p.x == 2 && p.y == 3 && p.z == 4 )
+
+    value.store( point{ 0, 0, 0 } );
+
+    // Readers never see a torn value, writers don't lose updates of each other
+    std::atomic_bool stop{ false };
+    std::atomic_bool torn{ false };
+    std::vector< std::thread > readers;
+
+    for( int i{ 0 }; i < 4; ++i )
+    {
+        readers.emplace_back( [ & ]()
+        {
+            uint64_t last{ 0 };
+
+            while( !stop )
+            {
+                const point current{ value.load() };
+
+                if( current.x != current.y || current.y != current.z || current.x < last )
+                {
+                    torn = true;
+                }
+
+                last = current.x;
+            }
+        } );
+    }
+
+    std::vector< std::thread > writers;
+    for( int i{ 0 }; i < 2; ++i )
+    {
+        writers.emplace_back( [ & ]()
+        {
+            for( int j{ 0 }; j < 5000; ++j )
+            {
+                value.update( []( point& v ){ ++v.x; ++v.y; ++v.z; } );
+            }
+        } );
+    }
+
+    for( auto& writer : writers )
+    {
+        writer.join();
+    }
+
+    stop = true;
+    for( auto& reader : readers )
+    {
+        reader.join();
+    }
+
+    p = value.load();
+    DYNAMIC_ASSERT( !torn && p.x == 10000 && p.y == 10000 && p.z == 10000 )
+}
+
 }// concurrency_tests
 
 #endif
@@ -1,7 +1,7 @@
 #pragma once
 
 #include <functional>
-#include "func_traits.h"
+#include "type_traits/func_traits.h"
 
 #ifdef WIN32
   #define CALL_CONV __cdecl